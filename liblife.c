@@ -0,0 +1,346 @@
+/*
+  Conway's Game of Life as a library; see liblife.h.
+  Instructions to compile the library:
+    `make liblife.a liblife.so`
+    See Makefile for details
+*/
+
+#define _GNU_SOURCE
+#include "liblife.h"
+#include "liblife_bits.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+struct life_engine {
+  int rows;
+  int cols;
+  size_t stride;
+  bool *cells; // current generation
+  bool *spare; // next generation; NULL when stepping in place
+  bool owned;  // cells and spare came from life_create
+  enum life_backend backend;
+  int p;       // tile rows
+  int q;       // tile columns
+  int threads; // 0: one per tile
+};
+
+struct tile {
+  /* Cells [x0, x1) x [y0, y1) plus copies of the ring around them, which may
+   * belong to other tiles. Rolling rows hold the tile width plus one halo
+   * cell each side.
+   */
+  int x0, x1, y0, y1;
+  bool *top;
+  bool *bottom;
+  bool *left;
+  bool *right;
+  bool *above;
+  bool *cur;
+  bool *below;
+};
+
+life_engine *life_create(int rows, int cols, enum life_backend backend,
+                         bool inplace) {
+  life_engine *e = malloc(sizeof(life_engine));
+  if (e == NULL || rows < 1 || cols < 1) {
+    free(e);
+    return NULL;
+  }
+  e->rows = rows;
+  e->cols = cols;
+  e->stride = cols;
+  e->cells = calloc((size_t)rows * cols, sizeof(bool));
+  e->spare = inplace ? NULL : calloc((size_t)rows * cols, sizeof(bool));
+  e->owned = true;
+  e->backend = backend;
+  e->p = 1;
+  e->q = 1;
+  e->threads = 0;
+  if (e->cells == NULL || (!inplace && e->spare == NULL)) {
+    life_destroy(e);
+    return NULL;
+  }
+  return e;
+}
+
+life_engine *life_create_from(bool *cells, int rows, int cols, size_t stride,
+                              enum life_backend backend) {
+  return life_create_from_pair(cells, NULL, rows, cols, stride, backend);
+}
+
+life_engine *life_create_from_pair(bool *cells, bool *spare, int rows,
+                                   int cols, size_t stride,
+                                   enum life_backend backend) {
+  life_engine *e = malloc(sizeof(life_engine));
+  if (e == NULL || cells == NULL || rows < 1 || cols < 1 ||
+      stride < (size_t)cols) {
+    free(e);
+    return NULL;
+  }
+  e->rows = rows;
+  e->cols = cols;
+  e->stride = stride;
+  e->cells = cells;
+  e->spare = spare;
+  e->owned = false;
+  e->backend = backend;
+  e->p = 1;
+  e->q = 1;
+  e->threads = 0;
+  return e;
+}
+
+void life_destroy(life_engine *engine) {
+  if (engine == NULL) {
+    return;
+  }
+  if (engine->owned) {
+    free(engine->cells);
+    free(engine->spare);
+  }
+  free(engine);
+}
+
+int life_set_decomposition(life_engine *engine, int p, int q) {
+  if (p < 1 || q < 1) {
+    return -1;
+  }
+  engine->p = p;
+  engine->q = q;
+  return 0;
+}
+
+int life_set_threads(life_engine *engine, int threads) {
+  if (threads < 0) {
+    return -1;
+  }
+  engine->threads = threads;
+  return 0;
+}
+
+static bool cell(const life_engine *e, const bool *src, long x, long y) {
+  // border of the dead: anything off the board
+  if (x < 0 || y < 0 || x >= e->rows || y >= e->cols) {
+    return false;
+  }
+  return src[x * e->stride + y];
+}
+
+static bool tile_init(const life_engine *e, int id, int p, int q,
+                      struct tile *t) {
+  // balanced split; with more tiles than cells some tiles are empty
+  int tp = id / q;
+  int tq = id % q;
+  t->x0 = (long)tp * e->rows / p;
+  t->x1 = (long)(tp + 1) * e->rows / p;
+  t->y0 = (long)tq * e->cols / q;
+  t->y1 = (long)(tq + 1) * e->cols / q;
+
+  int rows = t->x1 - t->x0;
+  int span = t->y1 - t->y0 + 2;
+  t->top = malloc(span * sizeof(bool));
+  t->bottom = malloc(span * sizeof(bool));
+  t->left = malloc((rows + 1) * sizeof(bool));
+  t->right = malloc((rows + 1) * sizeof(bool));
+  t->above = malloc(span * sizeof(bool));
+  t->cur = malloc(span * sizeof(bool));
+  t->below = malloc(span * sizeof(bool));
+  return t->top && t->bottom && t->left && t->right && t->above && t->cur &&
+         t->below;
+}
+
+static void tile_free(struct tile *t) {
+  free(t->top);
+  free(t->bottom);
+  free(t->left);
+  free(t->right);
+  free(t->above);
+  free(t->cur);
+  free(t->below);
+}
+
+static void save_halo(const life_engine *e, const bool *src, struct tile *t) {
+  // must happen before any neighboring tile overwrites these cells
+  int span = t->y1 - t->y0 + 2;
+  for (int i = 0; i < span; i++) {
+    t->top[i] = cell(e, src, t->x0 - 1, t->y0 - 1 + i);
+    t->bottom[i] = cell(e, src, t->x1, t->y0 - 1 + i);
+  }
+  for (int x = t->x0; x < t->x1; x++) {
+    t->left[x - t->x0] = cell(e, src, x, t->y0 - 1);
+    t->right[x - t->x0] = cell(e, src, x, t->y1);
+  }
+}
+
+static void load_row(const life_engine *e, const bool *src, struct tile *t,
+                     bool *buf, int x) {
+  // original row x over [y0 - 1, y1]; the edge cells come from the halo
+  int cols = t->y1 - t->y0;
+  buf[0] = t->left[x - t->x0];
+  memcpy(buf + 1, src + x * e->stride + t->y0, cols * sizeof(bool));
+  buf[cols + 1] = t->right[x - t->x0];
+}
+
+static void sweep_tile(const life_engine *e, const bool *src, bool *dst,
+                       struct tile *t) {
+  /* Keeps the original values of rows x-1, x and x+1 in three rolling
+   * buffers, so dst may be src.
+   */
+  int cols = t->y1 - t->y0;
+  int span = cols + 2;
+  if (t->x1 <= t->x0 || cols <= 0) {
+    return;
+  }
+  memcpy(t->above, t->top, span * sizeof(bool));
+  load_row(e, src, t, t->cur, t->x0);
+  for (int x = t->x0; x < t->x1; x++) {
+    if (x + 1 < t->x1) {
+      load_row(e, src, t, t->below, x + 1);
+    } else {
+      memcpy(t->below, t->bottom, span * sizeof(bool));
+    }
+    const bool *a = t->above, *c = t->cur, *b = t->below;
+    bool *out = dst + x * e->stride + t->y0;
+    for (int i = 1; i <= cols; i++) {
+      /* ordered like so:
+         123
+         4 5
+         678 */
+      int neighbors = a[i - 1] + a[i] + a[i + 1] + c[i - 1] + c[i + 1] +
+                      b[i - 1] + b[i] + b[i + 1];
+      out[i - 1] = neighbors == 3 || (c[i] && neighbors == 2);
+    }
+    bool *temp = t->above;
+    t->above = t->cur;
+    t->cur = t->below;
+    t->below = temp;
+  }
+}
+
+static void step_tiles(const life_engine *e, struct tile *tiles, int ntiles,
+                       int tid, int nthreads, int generations) {
+  /* Run by each of nthreads threads, which take every nthreads-th tile.
+   * Every generation waits for all tiles to finish reading before anyone
+   * writes (in place), and for all to finish writing before anyone reads the
+   * next one.
+   */
+  bool *src = e->cells;
+  bool *dst = e->spare ? e->spare : e->cells;
+  for (int g = 0; g < generations; g++) {
+    for (int i = tid; i < ntiles; i += nthreads) {
+      save_halo(e, src, &tiles[i]);
+    }
+    if (dst == src) {
+#pragma omp barrier
+    }
+    for (int i = tid; i < ntiles; i += nthreads) {
+      sweep_tile(e, src, dst, &tiles[i]);
+    }
+#pragma omp barrier
+    bool *temp = src;
+    src = dst;
+    dst = temp;
+  }
+}
+
+int life_step(life_engine *engine, int generations) {
+  if (generations < 0) {
+    return -1;
+  }
+  int p = engine->backend == LIFE_OPENMP ? engine->p : 1;
+  int q = engine->backend == LIFE_OPENMP ? engine->q : 1;
+  int ntiles = p * q;
+  int nthreads = engine->threads > 0 ? engine->threads : ntiles;
+  struct tile *tiles = calloc(ntiles, sizeof(struct tile));
+  bool ok = tiles != NULL;
+  for (int i = 0; ok && i < ntiles; i++) {
+    ok = tile_init(engine, i, p, q, &tiles[i]);
+  }
+
+  if (ok) {
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthreads) if (ntiles > 1 && nthreads > 1)
+    step_tiles(engine, tiles, ntiles, omp_get_thread_num(),
+               omp_get_num_threads(), generations);
+#else
+    step_tiles(engine, tiles, ntiles, 0, 1, generations);
+#endif
+    if (engine->spare && generations % 2) {
+      bool *temp = engine->cells;
+      engine->cells = engine->spare;
+      engine->spare = temp;
+    }
+  }
+
+  for (int i = 0; tiles && i < ntiles; i++) {
+    tile_free(&tiles[i]);
+  }
+  free(tiles);
+  return ok ? 0 : -1;
+}
+
+void life_packed_step_row(const uint64_t *above, const uint64_t *cur,
+                          const uint64_t *below, uint64_t *out, int words,
+                          uint64_t lastmask) {
+  // missing rows are treated as dead, like the border
+  const uint64_t *rows[3] = {above, cur, below};
+  for (int i = 0; i < words; i++) {
+    uint64_t w[3], c[3], e[3]; // west, own and east word of each row
+    for (int r = 0; r < 3; r++) {
+      c[r] = rows[r] ? rows[r][i] : 0;
+      w[r] = rows[r] && i > 0 ? rows[r][i - 1] : 0;
+      e[r] = rows[r] && i < words - 1 ? rows[r][i + 1] : 0;
+    }
+    out[i] = life_next_word(w[0], c[0], e[0], w[1], c[1], e[1], w[2], c[2],
+                            e[2]);
+  }
+  out[words - 1] &= lastmask; // keep padding cells dead
+}
+
+int life_get_region(const life_engine *engine, int row, int col, int rows,
+                    int cols, bool *out) {
+  if (row < 0 || col < 0 || rows < 0 || cols < 0 ||
+      row + rows > engine->rows || col + cols > engine->cols) {
+    return -1;
+  }
+  for (int x = 0; x < rows; x++) {
+    memcpy(out + (size_t)x * cols,
+           engine->cells + (size_t)(row + x) * engine->stride + col,
+           cols * sizeof(bool));
+  }
+  return 0;
+}
+
+int life_set_region(life_engine *engine, int row, int col, int rows, int cols,
+                    const bool *in) {
+  if (row < 0 || col < 0 || rows < 0 || cols < 0 ||
+      row + rows > engine->rows || col + cols > engine->cols) {
+    return -1;
+  }
+  for (int x = 0; x < rows; x++) {
+    memcpy(engine->cells + (size_t)(row + x) * engine->stride + col,
+           in + (size_t)x * cols, cols * sizeof(bool));
+  }
+  return 0;
+}
+
+bool *life_cells(life_engine *engine) { return engine->cells; }
+
+size_t life_stride(const life_engine *engine) { return engine->stride; }
+
+int life_rows(const life_engine *engine) { return engine->rows; }
+
+int life_cols(const life_engine *engine) { return engine->cols; }
+
+long life_population(const life_engine *engine) {
+  long alive = 0;
+  for (long x = 0; x < engine->rows; x++) {
+    for (long y = 0; y < engine->cols; y++) {
+      alive += engine->cells[x * engine->stride + y];
+    }
+  }
+  return alive;
+}
@@ -0,0 +1,121 @@
+/*
+  Conway's Game of Life as a library.
+  Build with `make liblife.a` or `make liblife.so`; see Makefile for details.
+
+  A board is `rows` x `cols` cells stored row-major, `stride` bools apart.
+  Cells outside the board are always dead. Engines share no state, so any
+  number of them can be stepped at once from different threads.
+  A universe has no edges; see life_universe_create.
+  Ensembles and bit-packed rows are for drivers with their own storage.
+*/
+
+#ifndef LIBLIFE_H
+#define LIBLIFE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct life_engine life_engine;
+
+enum life_backend {
+  LIFE_SERIAL, // one thread, the caller's
+  LIFE_OPENMP, // tiles x tiles threads, see life_set_decomposition
+};
+
+// Engine owning a dead board. With inplace it keeps a few rows of scratch per
+// thread instead of a second board. Returns NULL if allocation fails.
+life_engine *life_create(int rows, int cols, enum life_backend backend,
+                         bool inplace);
+
+// Engine stepping the caller's cells directly; always in place. The buffer
+// must outlive the engine and is not freed by life_destroy.
+life_engine *life_create_from(bool *cells, int rows, int cols, size_t stride,
+                              enum life_backend backend);
+
+// As life_create_from, but double buffered: each generation is written to the
+// other buffer, which must have the same shape. life_cells says which is
+// current.
+life_engine *life_create_from_pair(bool *cells, bool *spare, int rows,
+                                   int cols, size_t stride,
+                                   enum life_backend backend);
+
+void life_destroy(life_engine *engine);
+
+// Split the board into p x q tiles, one OpenMP thread each. Defaults to 1 x 1.
+// Returns -1 if p or q is not positive.
+int life_set_decomposition(life_engine *engine, int p, int q);
+
+// Share the tiles among this many OpenMP threads instead, round robin; 0 goes
+// back to one per tile. More, smaller tiles than threads help when a tile's
+// rows do not fit in cache. Returns -1 if threads is negative.
+int life_set_threads(life_engine *engine, int threads);
+
+// Returns -1 if generations is negative or scratch space could not be
+// allocated; the board is untouched.
+int life_step(life_engine *engine, int generations);
+
+// Copy a rows x cols region at (row, col) out of/into a packed buffer.
+// Returns -1 if the region is not inside the board.
+int life_get_region(const life_engine *engine, int row, int col, int rows,
+                    int cols, bool *out);
+int life_set_region(life_engine *engine, int row, int col, int rows, int cols,
+                    const bool *in);
+
+// Current generation. The pointer moves after life_step unless in place.
+bool *life_cells(life_engine *engine);
+size_t life_stride(const life_engine *engine);
+int life_rows(const life_engine *engine);
+int life_cols(const life_engine *engine);
+long life_population(const life_engine *engine);
+
+// Unbounded universe: only 64 x 64 chunks holding live cells (and their
+// borders) are stored, and any long coordinate is valid, negative included.
+typedef struct life_universe life_universe;
+
+// Empty universe. LIFE_OPENMP steps chunks on all OpenMP threads unless
+// life_universe_set_threads says otherwise. Returns NULL if allocation fails.
+life_universe *life_universe_create(enum life_backend backend);
+void life_universe_destroy(life_universe *universe);
+int life_universe_set_threads(life_universe *universe, int threads);
+
+// Returns -1 if a chunk could not be allocated.
+int life_universe_step(life_universe *universe, int generations);
+
+bool life_universe_get(const life_universe *universe, long row, long col);
+int life_universe_set(life_universe *universe, long row, long col,
+                      bool alive);
+int life_universe_get_region(const life_universe *universe, long row,
+                             long col, int rows, int cols, bool *out);
+int life_universe_set_region(life_universe *universe, long row, long col,
+                             int rows, int cols, const bool *in);
+
+long life_universe_population(const life_universe *universe);
+long life_universe_chunks(const life_universe *universe);
+// Inclusive bounding box of the live cells; false if there are none.
+bool life_universe_bounds(const life_universe *universe, long *row0,
+                          long *col0, long *row1, long *col1);
+
+// One generation of a bit-packed row: bit j of word i is cell 64 * i + j.
+// NULL above or below rows are dead; bits of out past the last cell are
+// cleared with lastmask.
+void life_packed_step_row(const uint64_t *above, const uint64_t *cur,
+                          const uint64_t *below, uint64_t *out, int words,
+                          uint64_t lastmask);
+
+#define LIFE_MAX_PERIOD 15 // longest period life_ensemble_run looks for
+
+struct life_ensemble_result {
+  int population;  // after the last generation
+  int period;      // first repeat seen, up to LIFE_MAX_PERIOD; 0 if none
+  int detected_at; // generation the repeat was seen at
+};
+
+// Run count independent rows x cols boards, board b filled from rand_r with
+// seed + b, on this many OpenMP threads (0: the default). Fills
+// results[0 .. count). Returns -1 if allocation fails.
+int life_ensemble_run(int count, int rows, int cols, unsigned int seed,
+                      int generations, int threads,
+                      struct life_ensemble_result *results);
+
+#endif
@@ -0,0 +1,38 @@
+/*
+  Bit-packed stepping shared by liblife's sources; not installed.
+  Bit j of a word is cell j of a run of 64, so the west neighbor of a cell is
+  one bit down and the east neighbor one bit up.
+*/
+
+#ifndef LIBLIFE_BITS_H
+#define LIBLIFE_BITS_H
+
+#include <stdint.h>
+
+static inline uint64_t life_next_word(uint64_t aw, uint64_t ac, uint64_t ae,
+                                      uint64_t cw, uint64_t cc, uint64_t ce,
+                                      uint64_t bw, uint64_t bc, uint64_t be) {
+  /* Next generation of word cc: a/c/b are the rows above, at and below, w/c/e
+   * the words to the west, this one and the east. The eight neighbor masks are
+   * summed bitwise with adders, 64 cells at once.
+   */
+  uint64_t n0 = (ac << 1) | (aw >> 63), n1 = ac, n2 = (ac >> 1) | (ae << 63);
+  uint64_t n3 = (cc << 1) | (cw >> 63), n4 = (cc >> 1) | (ce << 63);
+  uint64_t n5 = (bc << 1) | (bw >> 63), n6 = bc, n7 = (bc >> 1) | (be << 63);
+
+  // ones is the 1s bit of the count, c1..c4 each weigh 2
+  uint64_t s1 = n0 ^ n1 ^ n2;
+  uint64_t c1 = (n0 & n1) | (n2 & (n0 ^ n1));
+  uint64_t s2 = n3 ^ n4 ^ n5;
+  uint64_t c2 = (n3 & n4) | (n5 & (n3 ^ n4));
+  uint64_t s3 = n6 ^ n7;
+  uint64_t c3 = n6 & n7;
+  uint64_t ones = s1 ^ s2 ^ s3;
+  uint64_t c4 = (s1 & s2) | (s3 & (s1 ^ s2));
+  // count is 2 or 3 exactly when one of c1..c4 is set
+  uint64_t p = c1 ^ c2, q = c1 & c2;
+  uint64_t r = c3 ^ c4, u = c3 & c4;
+  return ((p ^ r) & ~(q | u)) & (ones | cc);
+}
+
+#endif
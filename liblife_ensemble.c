@@ -0,0 +1,154 @@
+/*
+  Ensembles of small independent boards for liblife; see liblife.h.
+  Instructions to compile the library:
+    `make liblife.a liblife.so`
+    See Makefile for details
+*/
+
+#define _GNU_SOURCE
+#include "liblife.h"
+#include <stdint.h>
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define LANES 64 // boards interleaved per group
+#define PERIOD_WINDOW (LIFE_MAX_PERIOD + 1) // generations of hashes kept
+
+struct group_shape {
+  // rows and columns of one board, border of the dead included
+  int rows;
+  int cols;
+};
+
+static void step_group(const struct group_shape *s, const bool *restrict board,
+                       bool *restrict new) {
+  /* One generation of LANES interleaved boards.
+   * Cell (x, y) of every lane sits in one contiguous run of LANES bools, so
+   * the innermost loop is the same stencil over independent boards and
+   * vectorizes cleanly. Summing as bytes keeps it in 16-lane vectors.
+   */
+  const long row = (long)s->cols * LANES;
+  for (int x = 1; x < s->rows - 1; x++) {
+    for (int y = 1; y < s->cols - 1; y++) {
+      const unsigned char *c =
+          (const unsigned char *)board + x * row + y * LANES;
+      unsigned char *n = (unsigned char *)new + x * row + y * LANES;
+      for (int l = 0; l < LANES; l++) {
+        unsigned char neighbors =
+            c[l - row - LANES] + c[l - row] + c[l - row + LANES] +
+            c[l - LANES] + c[l + LANES] + c[l + row - LANES] + c[l + row] +
+            c[l + row + LANES];
+        // alive with 3 neighbors, or alive already with 2
+        n[l] = (neighbors == 3) | (c[l] & (neighbors == 2));
+      }
+    }
+  }
+}
+
+static void hash_group(const struct group_shape *s, const bool *board,
+                       uint64_t *hashes) {
+  // FNV-1a over the interior of each lane; equal hashes mean a repeat
+  for (int l = 0; l < LANES; l++) {
+    hashes[l] = 14695981039346656037ULL;
+  }
+  for (int x = 1; x < s->rows - 1; x++) {
+    for (int y = 1; y < s->cols - 1; y++) {
+      const bool *c = board + ((long)x * s->cols + y) * LANES;
+      for (int l = 0; l < LANES; l++) {
+        hashes[l] = (hashes[l] ^ c[l]) * 1099511628211ULL;
+      }
+    }
+  }
+}
+
+static bool run_group(const struct group_shape *s, bool *board, bool *new,
+                      int first, int count, unsigned int seed, int generations,
+                      struct life_ensemble_result *results) {
+  // lanes [0, count) are boards first, first + 1, ...; the rest stay dead
+  uint64_t *history = malloc(PERIOD_WINDOW * LANES * sizeof(uint64_t));
+  if (history == NULL) {
+    return false;
+  }
+  for (int l = 0; l < count; l++) {
+    unsigned int lane_seed = seed + first + l;
+    for (int x = 1; x < s->rows - 1; x++) {
+      for (int y = 1; y < s->cols - 1; y++) {
+        board[((long)x * s->cols + y) * LANES + l] = rand_r(&lane_seed) & 1;
+      }
+    }
+    results[l].period = 0;
+    results[l].detected_at = 0;
+  }
+
+  hash_group(s, board, history);
+  for (int i = 1; i <= generations; i++) {
+    step_group(s, board, new);
+    bool *temp = new;
+    new = board;
+    board = temp;
+
+    uint64_t *now = history + (i % PERIOD_WINDOW) * LANES;
+    hash_group(s, board, now);
+    for (int k = 1; k < PERIOD_WINDOW && k <= i; k++) {
+      uint64_t *then = history + ((i - k) % PERIOD_WINDOW) * LANES;
+      for (int l = 0; l < count; l++) {
+        if (results[l].period == 0 && now[l] == then[l]) {
+          results[l].period = k;
+          results[l].detected_at = i;
+        }
+      }
+    }
+  }
+
+  for (int l = 0; l < count; l++) {
+    int alive = 0;
+    for (int x = 1; x < s->rows - 1; x++) {
+      for (int y = 1; y < s->cols - 1; y++) {
+        alive += board[((long)x * s->cols + y) * LANES + l];
+      }
+    }
+    results[l].population = alive;
+  }
+  free(history);
+  return true;
+}
+
+int life_ensemble_run(int count, int rows, int cols, unsigned int seed,
+                      int generations, int threads,
+                      struct life_ensemble_result *results) {
+  /* Boards live in one arena as groups of LANES, laid out [group][x][y][lane];
+   * threads take whole groups so each works on its own cache-sized block.
+   */
+  if (count < 0 || rows < 1 || cols < 1 || generations < 0 || threads < 0) {
+    return -1;
+  }
+  struct group_shape s = {rows + 2, cols + 2};
+  int groups = (count + LANES - 1) / LANES;
+  long cells = (long)s.rows * s.cols * LANES; // per group
+  bool *arena = calloc(2 * groups * cells, sizeof(bool));
+  if (arena == NULL) {
+    return -1;
+  }
+
+  int nthreads = threads;
+#ifdef _OPENMP
+  if (nthreads == 0) {
+    nthreads = omp_get_max_threads();
+  }
+#endif
+  bool ok = true;
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic)             \
+    reduction(&& : ok)
+  for (int g = 0; g < groups; g++) {
+    int first = g * LANES;
+    int lanes = count - first < LANES ? count - first : LANES;
+    bool *board = arena + 2 * g * cells;
+    ok = run_group(&s, board, board + cells, first, lanes, seed, generations,
+                   results + first) &&
+         ok;
+  }
+  free(arena);
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,390 @@
+/*
+  Unbounded Game of Life universe for liblife; see liblife.h.
+  Instructions to compile the library:
+    `make liblife.a liblife.so`
+    See Makefile for details
+*/
+
+#define _GNU_SOURCE
+#include "liblife.h"
+#include "liblife_bits.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define CHUNK 64 // chunk side; one uint64_t per chunk row
+
+struct chunk {
+  /* 64 x 64 cells, bit j of rows[g][i] is cell (64 * cx + i, 64 * cy + j)
+   * in generation buffer g. Neighbors are cached in the order
+   *   0 1 2
+   *   3   4
+   *   5 6 7
+   * and NULL when not allocated, i.e. all dead.
+   */
+  long cx, cy;
+  uint64_t rows[2][CHUNK];
+  struct chunk *nb[8];
+  struct chunk *next; // hash chain
+  long index;         // position in the universe's list
+  int idle;           // generations in a row without a live cell
+};
+
+struct life_universe {
+  struct chunk **buckets;
+  long nbuckets; // power of two
+  struct chunk **list;
+  long nchunks;
+  long capacity;
+  int cur; // generation buffer holding the present
+  enum life_backend backend;
+  int threads; // 0: OpenMP default
+  long population;
+};
+
+static const int DX[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+static const int DY[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+static const uint64_t DEAD[CHUNK];
+
+static long bucket_of(const life_universe *u, long cx, long cy) {
+  uint64_t h = (uint64_t)cx * 0x9E3779B97F4A7C15ULL ^
+               (uint64_t)cy * 0xC2B2AE3D27D4EB4FULL;
+  return (h ^ (h >> 29)) & (u->nbuckets - 1);
+}
+
+static struct chunk *find(const life_universe *u, long cx, long cy) {
+  for (struct chunk *c = u->buckets[bucket_of(u, cx, cy)]; c; c = c->next) {
+    if (c->cx == cx && c->cy == cy) {
+      return c;
+    }
+  }
+  return NULL;
+}
+
+static bool grow(life_universe *u) {
+  // keep chains about one long
+  long nbuckets = u->nbuckets * 2;
+  struct chunk **buckets = calloc(nbuckets, sizeof(struct chunk *));
+  if (buckets == NULL) {
+    return false;
+  }
+  free(u->buckets);
+  u->buckets = buckets;
+  u->nbuckets = nbuckets;
+  for (long i = 0; i < u->nchunks; i++) {
+    struct chunk *c = u->list[i];
+    long b = bucket_of(u, c->cx, c->cy);
+    c->next = u->buckets[b];
+    u->buckets[b] = c;
+  }
+  return true;
+}
+
+static struct chunk *insert(life_universe *u, long cx, long cy) {
+  // new dead chunk, linked both ways with whichever neighbors exist
+  if (u->nchunks >= u->nbuckets && !grow(u)) {
+    return NULL;
+  }
+  if (u->nchunks == u->capacity) {
+    long capacity = u->capacity * 2;
+    struct chunk **list = realloc(u->list, capacity * sizeof(struct chunk *));
+    if (list == NULL) {
+      return NULL;
+    }
+    u->list = list;
+    u->capacity = capacity;
+  }
+  struct chunk *c = calloc(1, sizeof(struct chunk));
+  if (c == NULL) {
+    return NULL;
+  }
+  c->cx = cx;
+  c->cy = cy;
+  long b = bucket_of(u, cx, cy);
+  c->next = u->buckets[b];
+  u->buckets[b] = c;
+  c->index = u->nchunks;
+  u->list[u->nchunks++] = c;
+  for (int d = 0; d < 8; d++) {
+    c->nb[d] = find(u, cx + DX[d], cy + DY[d]);
+    if (c->nb[d]) {
+      c->nb[d]->nb[7 - d] = c; // 7 - d is the opposite direction
+    }
+  }
+  return c;
+}
+
+static void erase(life_universe *u, struct chunk *c) {
+  for (int d = 0; d < 8; d++) {
+    if (c->nb[d]) {
+      c->nb[d]->nb[7 - d] = NULL;
+    }
+  }
+  struct chunk **link = &u->buckets[bucket_of(u, c->cx, c->cy)];
+  while (*link != c) {
+    link = &(*link)->next;
+  }
+  *link = c->next;
+  struct chunk *last = u->list[--u->nchunks];
+  last->index = c->index;
+  u->list[c->index] = last;
+  free(c);
+}
+
+life_universe *life_universe_create(enum life_backend backend) {
+  life_universe *u = calloc(1, sizeof(life_universe));
+  if (u == NULL) {
+    return NULL;
+  }
+  u->nbuckets = 64;
+  u->capacity = 64;
+  u->buckets = calloc(u->nbuckets, sizeof(struct chunk *));
+  u->list = malloc(u->capacity * sizeof(struct chunk *));
+  u->backend = backend;
+  if (u->buckets == NULL || u->list == NULL) {
+    life_universe_destroy(u);
+    return NULL;
+  }
+  return u;
+}
+
+void life_universe_destroy(life_universe *universe) {
+  if (universe == NULL) {
+    return;
+  }
+  for (long i = 0; i < universe->nchunks; i++) {
+    free(universe->list[i]);
+  }
+  free(universe->list);
+  free(universe->buckets);
+  free(universe);
+}
+
+int life_universe_set_threads(life_universe *universe, int threads) {
+  if (threads < 0) {
+    return -1;
+  }
+  universe->threads = threads;
+  return 0;
+}
+
+int life_universe_set(life_universe *universe, long row, long col,
+                      bool alive) {
+  // floor division, so negative coordinates land in negative chunks
+  long cx = row >> 6, cy = col >> 6;
+  uint64_t bit = 1ULL << (col & (CHUNK - 1));
+  struct chunk *c = find(universe, cx, cy);
+  if (c == NULL && alive) {
+    c = insert(universe, cx, cy);
+    if (c == NULL) {
+      return -1;
+    }
+  }
+  if (c != NULL) {
+    uint64_t *word = &c->rows[universe->cur][row & (CHUNK - 1)];
+    universe->population += alive - ((*word & bit) != 0);
+    *word = alive ? *word | bit : *word & ~bit;
+    c->idle = 0;
+  }
+  return 0;
+}
+
+bool life_universe_get(const life_universe *universe, long row, long col) {
+  struct chunk *c = find(universe, row >> 6, col >> 6);
+  if (c == NULL) {
+    return false;
+  }
+  uint64_t word = c->rows[universe->cur][row & (CHUNK - 1)];
+  return (word >> (col & (CHUNK - 1))) & 1;
+}
+
+int life_universe_get_region(const life_universe *universe, long row,
+                             long col, int rows, int cols, bool *out) {
+  if (rows < 0 || cols < 0) {
+    return -1;
+  }
+  for (int x = 0; x < rows; x++) {
+    for (int y = 0; y < cols; y++) {
+      out[(size_t)x * cols + y] = life_universe_get(universe, row + x, col + y);
+    }
+  }
+  return 0;
+}
+
+int life_universe_set_region(life_universe *universe, long row, long col,
+                             int rows, int cols, const bool *in) {
+  if (rows < 0 || cols < 0) {
+    return -1;
+  }
+  for (int x = 0; x < rows; x++) {
+    for (int y = 0; y < cols; y++) {
+      if (life_universe_set(universe, row + x, col + y,
+                            in[(size_t)x * cols + y]) != 0) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static bool live_edges(const uint64_t *r, bool need[8]) {
+  /* Which neighbors a birth could land in, i.e. which edges and corners of
+   * these rows hold a live cell, in the nb[] order. False if all are dead.
+   */
+  uint64_t any = 0, west = 0, east = 0;
+  for (int x = 0; x < CHUNK; x++) {
+    any |= r[x];
+    west |= r[x] & 1;
+    east |= r[x] >> 63;
+  }
+  need[0] = r[0] & 1;
+  need[1] = r[0] != 0;
+  need[2] = r[0] >> 63;
+  need[3] = west;
+  need[4] = east;
+  need[5] = r[CHUNK - 1] & 1;
+  need[6] = r[CHUNK - 1] != 0;
+  need[7] = r[CHUNK - 1] >> 63;
+  return any != 0;
+}
+
+static bool expand(life_universe *u) {
+  /* Births can only happen next to a live cell, so every chunk with a live
+   * cell on an edge needs the neighbor across that edge to exist.
+   * Only chunks present at the start are scanned; new ones are dead.
+   */
+  long n = u->nchunks;
+  for (long i = 0; i < n; i++) {
+    struct chunk *c = u->list[i];
+    bool need[8];
+    if (!live_edges(c->rows[u->cur], need)) {
+      continue;
+    }
+    for (int d = 0; d < 8; d++) {
+      if (need[d] && c->nb[d] == NULL &&
+          insert(u, c->cx + DX[d], c->cy + DY[d]) == NULL) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool needed(const life_universe *u, const struct chunk *c) {
+  // whether expand would create c again for a live edge of a neighbor
+  for (int d = 0; d < 8; d++) {
+    bool need[8];
+    // the direction back to c from neighbor d is 7 - d
+    if (c->nb[d] && live_edges(c->nb[d]->rows[u->cur], need) &&
+        need[7 - d]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static long step_chunk(struct chunk *c, int cur) {
+  // next generation into the other buffer; returns its population
+  const uint64_t *nb[8];
+  for (int d = 0; d < 8; d++) {
+    nb[d] = c->nb[d] ? c->nb[d]->rows[cur] : DEAD;
+  }
+  const uint64_t *w = nb[3], *m = c->rows[cur], *e = nb[4];
+  uint64_t *out = c->rows[!cur];
+  long alive = 0;
+  for (int x = 0; x < CHUNK; x++) {
+    uint64_t aw, ac, ae, bw, bc, be;
+    if (x == 0) {
+      aw = nb[0][CHUNK - 1], ac = nb[1][CHUNK - 1], ae = nb[2][CHUNK - 1];
+    } else {
+      aw = w[x - 1], ac = m[x - 1], ae = e[x - 1];
+    }
+    if (x == CHUNK - 1) {
+      bw = nb[5][0], bc = nb[6][0], be = nb[7][0];
+    } else {
+      bw = w[x + 1], bc = m[x + 1], be = e[x + 1];
+    }
+    out[x] = life_next_word(aw, ac, ae, w[x], m[x], e[x], bw, bc, be);
+    alive += __builtin_popcountll(out[x]);
+  }
+  return alive;
+}
+
+int life_universe_step(life_universe *universe, int generations) {
+  /* Each generation:
+   * 1. make sure every chunk a birth could land in exists (serial),
+   * 2. step all chunks into their spare buffer (parallel; each writes only
+   *    its own spare and reads the present of its cached neighbors),
+   * 3. free chunks that stayed dead for two generations, so a chunk a
+   *    glider just left is kept in case the next one comes through, unless
+   *    a neighbor's live edge would make step 1 allocate them right back.
+   */
+  life_universe *u = universe;
+  for (int g = 0; g < generations; g++) {
+    if (!expand(u)) {
+      return -1;
+    }
+
+    long alive = 0;
+    int cur = u->cur;
+#ifdef _OPENMP
+    int threads = u->threads > 0 ? u->threads : omp_get_max_threads();
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16)          \
+    reduction(+ : alive) if (u->backend == LIFE_OPENMP && u->nchunks > 1)
+#endif
+    for (long i = 0; i < u->nchunks; i++) {
+      long n = step_chunk(u->list[i], cur);
+      u->list[i]->idle = n ? 0 : u->list[i]->idle + 1;
+      alive += n;
+    }
+    u->cur = !cur;
+    u->population = alive;
+
+    for (long i = u->nchunks - 1; i >= 0; i--) {
+      if (u->list[i]->idle >= 2 && !needed(u, u->list[i])) {
+        erase(u, u->list[i]); // moves the last chunk into i, already visited
+      }
+    }
+  }
+  return 0;
+}
+
+long life_universe_population(const life_universe *universe) {
+  return universe->population;
+}
+
+long life_universe_chunks(const life_universe *universe) {
+  return universe->nchunks;
+}
+
+bool life_universe_bounds(const life_universe *universe, long *row0,
+                          long *col0, long *row1, long *col1) {
+  // bounding box of live cells, inclusive
+  bool any = false;
+  for (long i = 0; i < universe->nchunks; i++) {
+    const struct chunk *c = universe->list[i];
+    const uint64_t *r = c->rows[universe->cur];
+    for (int x = 0; x < CHUNK; x++) {
+      if (r[x] == 0) {
+        continue;
+      }
+      long row = c->cx * CHUNK + x;
+      long lo = c->cy * CHUNK + __builtin_ctzll(r[x]);
+      long hi = c->cy * CHUNK + 63 - __builtin_clzll(r[x]);
+      if (!any) {
+        *row0 = *row1 = row;
+        *col0 = lo;
+        *col1 = hi;
+        any = true;
+      }
+      *row0 = row < *row0 ? row : *row0;
+      *row1 = row > *row1 ? row : *row1;
+      *col0 = lo < *col0 ? lo : *col0;
+      *col1 = hi > *col1 ? hi : *col1;
+    }
+  }
+  return any;
+}
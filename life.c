@@ -1,4 +1,5 @@
 #define _GNU_SOURCE
+#include "liblife.h"
 #include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -6,104 +7,46 @@
 #include <time.h>
 #include <unistd.h>
 
-const int border = 2;
-bool **create_2d_arr(int w, int h) {
-  bool **ptr = (bool **)malloc(w * sizeof(bool *));
-  if (ptr == NULL) {
-    fprintf(stderr, "Allocating the initial board failed.\n");
-  }
-
-  for (int i = 0; i < w; i++) {
-    ptr[i] = (bool *)malloc(h * sizeof(bool));
-    if (ptr[i] == NULL) {
-      fprintf(stderr, "Allocating the board row %d failed.\n", i);
-    }
-  }
-  return ptr;
-}
-
-void print_board(void *b, int w, int h) {
-  // expects full bounds of whole board
-  // TODO: omit border of the dead?
-  bool(**board) = b;
-  // bool(*board)[w] = b;
+void print_board(life_engine *engine) {
+  bool *board = life_cells(engine);
+  size_t stride = life_stride(engine);
   printf("\033[H"); // return to home i.e. upper left
-  for (int x = 0; x < w; x++) {
-    for (int y = 0; y < h; y++) {
-      printf(board[x][y] ? "\033[7m  \033[m" : "  "); // inverted tile or empty
+  for (int x = 0; x < life_rows(engine); x++) {
+    for (int y = 0; y < life_cols(engine); y++) {
+      // inverted tile or empty
+      printf(board[x * stride + y] ? "\033[7m  \033[m" : "  ");
     }
     printf("\033[E"); // newline
     fflush(stdout);
   }
 };
 
-void progress_board(void *b, void *n, int w, int h) {
-  // expects full bounds of whole board
-  bool(**board) = b;
-  bool(**new) = n;
-  int neighbors;
-  for (int x = 1; x < w - 1; x++) {
-    for (int y = 1; y < h - 1; y++) {
-      /* ordered like so:
-         123
-         4 5
-         678 */
-      // TODO: reduce to 3 memory accesses with int, hahahhaha
-      neighbors = board[x - 1][y - 1] + board[x - 1][y] + board[x - 1][y + 1] +
-                  board[x][y - 1] + board[x][y + 1] + board[x + 1][y - 1] +
-                  board[x + 1][y] + board[x + 1][y + 1];
-      if (board[x][y]) { // living cell rules
-        if (neighbors == 2 || neighbors == 3) {
-          new[x][y] = true; // remains alive
-        } else {
-          new[x][y] = false; // dead, over or under populated
-        }
-      } else { // dead cell rules
-        if (neighbors == 3) {
-          new[x][y] = true; // becomes alive
-        } else {
-          new[x][y] = false; // remains dead
-        }
-      }
-    }
-  }
-
-  for (int x = 1; x < w - 1; x++) { // don't replace border of the dead
-    for (int y = 1; y < h - 1; y++) {
-      board[x][y] = new[x][y];
-    }
+void play_game_of_life(int w, int h, int gens, bool show, bool inplace) {
+  life_engine *engine = life_create(h, w, LIFE_SERIAL, inplace);
+  if (engine == NULL) {
+    fprintf(stderr, "Allocating the initial board failed.\n");
+    exit(1);
   }
-}
-
-void play_game_of_life(int w, int h, int gens, bool show) {
-  w = w + border;
-  h = h + border;
-  int w_bound = w - 1;
-  int h_bound = h - 1;
-
-  bool **board = create_2d_arr(w, h);
-  bool **newboard = create_2d_arr(w, h);
 
   // fill board randomly
-  for (int x = 0; x < w; x++) {
-    for (int y = 0; y < h; y++) {
-      if (x == 0 || y == 0 || x == w_bound || y == h_bound) {
-        board[x][y] = false; // border of the dead
-      } else {
-        board[x][y] = rand() & 1;
-      }
+  bool *board = life_cells(engine);
+  size_t stride = life_stride(engine);
+  for (int x = 0; x < h; x++) {
+    for (int y = 0; y < w; y++) {
+      board[x * stride + y] = rand() & 1;
     }
   }
 
-  for (int i = 0; i < gens; i++) {
-    if (show) {
-      print_board(board, w, h);
+  if (show) {
+    for (int i = 0; i < gens; i++) {
+      print_board(engine);
       usleep(200000);
+      life_step(engine, 1);
     }
-    progress_board(board, newboard, w, h);
+  } else {
+    life_step(engine, gens);
   }
-  free(board);
-  free(newboard);
+  life_destroy(engine);
 }
 
 int main(int argc, char **argv) {
@@ -112,6 +55,7 @@ int main(int argc, char **argv) {
   int height = 10;
   int generations = 10;
   static int show = false;
+  static int inplace = false;
 
   int option_index = 0;
   static struct option long_options[] = {
@@ -120,9 +64,11 @@ int main(int argc, char **argv) {
       {"width", required_argument, 0, 'w'},
       {"height", required_argument, 0, 'h'},
       {"generations", required_argument, 0, 'g'},
+      {"inplace", no_argument, &inplace, 'i'},
+      {0, 0, 0, 0},
   };
 
-  while ((c = getopt_long(argc, argv, "Hw:h:g:s", long_options,
+  while ((c = getopt_long(argc, argv, "Hw:h:g:si", long_options,
                           &option_index)) != -1) {
     switch (c) {
     case 'H':
@@ -137,6 +83,9 @@ int main(int argc, char **argv) {
       printf("\t\t-s/--show: Show the simulation. Use a small board.\n");
       printf("\t\t\t Defaults to False. Do not use an overly large board!\n");
       printf("\t\t\t The simulation will run slower for viewing purposes.\n");
+      printf("\t\t-i/--inplace: Update the board in place.\n");
+      printf("\t\t\t Defaults to False. Keeps three rolling rows and a\n");
+      printf("\t\t\t halo ring instead of a second board, halving memory.\n");
       printf("\n");
       printf("\t\tExample execution: ./life -h 15 -w 20 -g 10 -s\n");
       printf("\t\tNOTE: There is no delay in\n");
@@ -154,6 +103,9 @@ int main(int argc, char **argv) {
     case 's':
       show = true;
       break;
+    case 'i':
+      inplace = true;
+      break;
     }
   }
 
@@ -166,5 +118,5 @@ int main(int argc, char **argv) {
   // }
 
   srand(time(NULL));
-  play_game_of_life(width, height, generations, show);
+  play_game_of_life(width, height, generations, show, inplace);
 }
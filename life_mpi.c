@@ -1,9 +1,12 @@
 #define _GNU_SOURCE
+#include "liblife.h"
+#include "tune_cache.h"
 #include <getopt.h>
 #include <mpi.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 // constants for arguments
@@ -12,12 +15,17 @@ int HEIGHT = 10;
 int GENERATIONS = 10;
 static int SHOW = false;
 static int NOBLOCK = false;
+static int INPLACE = false;
+static int TUNE = false;
+double TUNE_SECONDS = 10;
+char *CACHE = NULL;
 
 // constants for program
 const int BORDER = 2;
 bool **BOARD;
 bool **NEWBOARD;
 bool **TEMP;
+life_engine *ENGINE; // steps this process's strip, ghost rows included
 
 int W_BORD;
 int H_BORD;
@@ -89,7 +97,7 @@ void progress_board(int rank, int size) {
   // depends on prep in play_game_of_life
   MPI_Request sreq1, sreq2, rreq1, rreq2; // objs specific to noblock
   MPI_Status recv_stat, send_stat;
-  int x, y, neighbors, upper_board, lower_board;
+  int y, upper_board, lower_board;
   int local_rows_b = (HEIGHT / size) + BORDER;
 
   if (rank == (size - 1)) {
@@ -124,46 +132,46 @@ void progress_board(int rank, int size) {
                  MPI_STATUS_IGNORE);
   }
 
-  for (x = 1; x < local_rows_b - 1; x++) {
-    for (y = 1; y < W_BOUND; y++) {
-      /* ordered like so:
-         123
-         4 5
-         678 */
-      // TODO: reduce to 3 memory accesses with int
-      neighbors = BOARD[x - 1][y - 1] + BOARD[x - 1][y] + BOARD[x - 1][y + 1] +
-                  BOARD[x][y - 1] + BOARD[x][y + 1] + BOARD[x + 1][y - 1] +
-                  BOARD[x + 1][y] + BOARD[x + 1][y + 1];
-
-      if (BOARD[x][y]) { // living cell rules
-        if (neighbors == 2 || neighbors == 3) {
-          NEWBOARD[x][y] = true; // remains alive
-        } else {
-          NEWBOARD[x][y] = false; // dead, over or under populated
-        }
-      } else { // dead cell rules
-        if (neighbors == 3) {
-          NEWBOARD[x][y] = true; // becomes alive
-        } else {
-          NEWBOARD[x][y] = false; // remains dead
-        }
-      }
-    }
+  /* The ghost rows are stepped too, as if the board ended past them; that is
+   * wasted but harmless, as the next exchange overwrites them. Where there is
+   * no neighbor they are the border of the dead and must stay so.
+   */
+  life_step(ENGINE, 1);
+  if (!INPLACE) { // the engine wrote NEWBOARD
+    TEMP = NEWBOARD;
+    NEWBOARD = BOARD;
+    BOARD = TEMP;
+  }
+  for (y = 0; y < W_BORD; y++) {
+    BOARD[0][y] = false;
+    BOARD[local_rows_b - 1][y] = false;
   }
-  TEMP = NEWBOARD;
-  NEWBOARD = BOARD;
-  BOARD = TEMP;
 }
 
-void play_game_of_life(int rank, int size) {
+double play_game_of_life(int rank, int size) {
+  // returns how long the slowest process spent on the generations
   BOARD = create_2d_arr(rank, size);
-  NEWBOARD = create_2d_arr(rank, size);
+  if (!INPLACE) { // in place the engine keeps a few rows instead
+    NEWBOARD = create_2d_arr(rank, size);
+  }
   int local_rows = (HEIGHT / size);
   int local_rows_b = local_rows + BORDER;
 
   if (rank == (size - 1)) {
     local_rows_b += HEIGHT % size;
   }
+  // columns 0 and W_BOUND are the border of the dead, outside the engine
+  if (INPLACE) {
+    ENGINE = life_create_from(&BOARD[0][1], local_rows_b, WIDTH, W_BORD,
+                              LIFE_SERIAL);
+  } else {
+    ENGINE = life_create_from_pair(&BOARD[0][1], &NEWBOARD[0][1],
+                                   local_rows_b, WIDTH, W_BORD, LIFE_SERIAL);
+  }
+  if (ENGINE == NULL) {
+    fprintf(stderr, "Allocating the engine failed.\n");
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
 
   // consume random calls based on rank to sync
   int to_consume = (rank * local_rows * WIDTH);
@@ -175,15 +183,19 @@ void play_game_of_life(int rank, int size) {
   // fill board randomly
   for (int x = 0; x < local_rows_b; x++) {
     for (int y = 0; y < W_BORD; y++) {
-      if (x == 0 || y == 0 || x == local_rows_b - 1 || y == H_BOUND) {
+      if (x == 0 || y == 0 || x == local_rows_b - 1 || y == W_BOUND) {
         BOARD[x][y] = false; // border of the dead
       } else {
         BOARD[x][y] = rand() & 1;
       } // 1st loop sends borders before calc; no need to send/recv
-      NEWBOARD[x][y] = false; // guarantee newboard is empty
+      if (!INPLACE) {
+        NEWBOARD[x][y] = false; // guarantee newboard is empty
+      }
     }
   }
 
+  MPI_Barrier(MPI_COMM_WORLD);
+  double t1 = MPI_Wtime();
   for (int i = 0; i < GENERATIONS; i++) {
     if (SHOW) {
       print_board(rank, size);
@@ -191,25 +203,142 @@ void play_game_of_life(int rank, int size) {
     }
     progress_board(rank, size);
   }
+  double t2 = MPI_Wtime() - t1;
+  MPI_Allreduce(&t2, &t1, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  life_destroy(ENGINE);
   free_2d_arr(BOARD, rank, size);
-  free_2d_arr(NEWBOARD, rank, size);
+  if (!INPLACE) {
+    free_2d_arr(NEWBOARD, rank, size);
+  }
+  return t1;
+}
+
+void load_tuning(int rank) {
+  /* Lines are `procs width height noblock inplace gens_per_second`; only an
+   * exact match is used. Rank 0's host names the file and everyone follows it.
+   */
+  int flags[2] = {NOBLOCK, INPLACE};
+  FILE *in = rank == 0 ? fopen(CACHE, "r") : NULL;
+  char line[256];
+  int size;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  while (in != NULL && fgets(line, sizeof(line), in) != NULL) {
+    int procs, w, h, noblock, inplace;
+    if (line[0] != '#' &&
+        sscanf(line, "%d %d %d %d %d", &procs, &w, &h, &noblock, &inplace) ==
+            5 &&
+        procs == size && w == WIDTH && h == HEIGHT) {
+      flags[0] = noblock;
+      flags[1] = inplace;
+    }
+  }
+  if (in != NULL) {
+    fclose(in);
+  }
+  MPI_Bcast(flags, 2, MPI_INT, 0, MPI_COMM_WORLD);
+  NOBLOCK = flags[0];
+  INPLACE = flags[1];
+}
+
+void save_tuning(int size, double rate) {
+  // replace any entry for this layout
+  char entry[256];
+  snprintf(entry, sizeof(entry), "%d %d %d %d %d %g", size, WIDTH, HEIGHT,
+           NOBLOCK != 0, INPLACE != 0, rate);
+  if (tune_cache_save(CACHE,
+                      "# procs width height noblock inplace gens_per_second",
+                      entry, 3)) {
+    fprintf(stderr, "Writing the tuning cache %s failed.\n", CACHE);
+  }
+}
+
+void tune(int rank, int size) {
+  /* Processes always split the board into row strips, so there is no rank
+   * layout to pick; what varies per machine is the halo exchange (blocking
+   * or not) and whether the update is in place. Each variant gets one warm
+   * generation to size a ~50ms timed run. TUNE_SECONDS is a hard budget:
+   * past the first variant, one only runs if two of the slowest warm runs
+   * (board setup included) seen so far fit in what is left, and its timed
+   * run is cut to fit.
+   */
+  int generations = GENERATIONS;
+  int show = SHOW;
+  SHOW = false;
+  double start = MPI_Wtime();
+  double best = 0;
+  double slowest = 0; // warm run cost estimate for the next variant
+  int best_noblock = false, best_inplace = false;
+  if (rank == 0) {
+    printf("%8s %8s %14s\n", "noblock", "inplace", "gens/s");
+  }
+  for (int v = 0; v < 4; v++) {
+    double left = TUNE_SECONDS - (MPI_Wtime() - start);
+    MPI_Bcast(&left, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (best > 0 && 2 * slowest > left) {
+      break;
+    }
+    NOBLOCK = v & 1;
+    INPLACE = v >> 1;
+    GENERATIONS = 1;
+    double cost = MPI_Wtime();
+    double warm = play_game_of_life(rank, size);
+    cost = MPI_Wtime() - cost;
+    MPI_Allreduce(MPI_IN_PLACE, &cost, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    slowest = cost > slowest ? cost : slowest;
+    // the timed run pays the same setup again on top of its generations
+    double span = left - 2 * cost + warm;
+    span = span < 0.05 ? span : 0.05;
+    GENERATIONS = warm > 0 ? span / warm : 1000;
+    GENERATIONS = GENERATIONS < 1 ? 1 : GENERATIONS > 1000 ? 1000 : GENERATIONS;
+    double rate = GENERATIONS / play_game_of_life(rank, size);
+    if (rank == 0) {
+      printf("%8d %8d %14.2f\n", NOBLOCK, INPLACE, rate);
+    }
+    if (rate > best) {
+      best = rate;
+      best_noblock = NOBLOCK;
+      best_inplace = INPLACE;
+    }
+  }
+  NOBLOCK = best_noblock;
+  INPLACE = best_inplace;
+  GENERATIONS = generations;
+  SHOW = show;
+  if (rank == 0) {
+    printf("Best: noblock %d, inplace %d, %.2f gens/s (%.1f s tuning)\n",
+           NOBLOCK, INPLACE, best, MPI_Wtime() - start);
+    save_tuning(size, best);
+    printf("Saved to %s\n", CACHE);
+  }
 }
 
 int main(int argc, char **argv) {
   int c;
   int option_index = 0;
+  bool explicit = false; // -n/-i beat the tuning cache
   static struct option long_options[] = {
       {"help", no_argument, 0, 'H'},
       {"noblock", no_argument, &NOBLOCK, 'n'},
+      {"inplace", no_argument, &INPLACE, 'i'},
+      {"tune", no_argument, &TUNE, 'T'},
+      {"tune-seconds", required_argument, 0, 'S'},
+      {"cache", required_argument, 0, 'C'},
       {"show", no_argument, &SHOW, 's'},
       {"width", required_argument, 0, 'w'},
       {"height", required_argument, 0, 'h'},
       {"generations", required_argument, 0, 'g'},
+      {0, 0, 0, 0},
   };
 
-  while ((c = getopt_long(argc, argv, "Hw:h:g:sn", long_options,
+  while ((c = getopt_long(argc, argv, "Hw:h:g:sniTS:C:", long_options,
                           &option_index)) != -1) {
     switch (c) {
+    case 0: // long-only flags set their variable themselves
+      if (long_options[option_index].flag == &NOBLOCK ||
+          long_options[option_index].flag == &INPLACE) {
+        explicit = true;
+      }
+      break;
     case 'H':
       printf("\n");
       printf("\tConway's Game of Life in C\n");
@@ -234,6 +363,21 @@ int main(int argc, char **argv) {
       printf("\t\t-n/--noblock: Use non-blocking MPI calls.\n");
       printf("\t\t\t Defaults to False.\n");
 
+      printf("\t\t-i/--inplace: Update the board in place.\n");
+      printf("\t\t\t Defaults to False. Keeps three rolling rows and a\n");
+      printf("\t\t\t halo ring instead of a second board, halving memory.\n");
+
+      printf("\t\t-T/--tune: Time blocking/non-blocking exchange with and\n");
+      printf("\t\t\t without --inplace, save the fastest to the cache and\n");
+      printf("\t\t\t run with it. Without -n or -i, later runs with the\n");
+      printf("\t\t\t same process count and board size load it.\n");
+
+      printf("\t\t-S/--tune-seconds: Stop trying variants after this long.\n");
+      printf("\t\t\t Defaults to 10.\n");
+
+      printf("\t\t-C/--cache: Tuning cache file.\n");
+      printf("\t\t\t Defaults to ~/.cache/life_mpi.<hostname>.\n");
+
       printf("\n");
 
       printf("\t\tExample:\n");
@@ -254,6 +398,20 @@ int main(int argc, char **argv) {
       break;
     case 'n':
       NOBLOCK = true;
+      explicit = true;
+      break;
+    case 'i':
+      INPLACE = true;
+      explicit = true;
+      break;
+    case 'T':
+      TUNE = true;
+      break;
+    case 'S':
+      TUNE_SECONDS = atof(optarg);
+      break;
+    case 'C':
+      CACHE = optarg;
       break;
     }
   }
@@ -270,6 +428,17 @@ int main(int argc, char **argv) {
 
   srand(time(NULL));
 
+  // only rank 0 reads or writes the cache
+  if (rank == 0 && CACHE == NULL &&
+      (CACHE = tune_cache_path("life_mpi")) == NULL) {
+    fprintf(stderr, "Allocating the tuning cache path failed.\n");
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  if (TUNE) {
+    tune(rank, size);
+  } else if (!explicit) {
+    load_tuning(rank);
+  }
   play_game_of_life(rank, size);
   MPI_Finalize();
 }
@@ -4,183 +4,490 @@
   Course Section: CS 632
   Homework #: 3
   Instructions to compile the program:
-    `gcc ./life.c -o life -std=c99 -Wall -fopenmp -Ofast`
+    `make life_openmp`
+    See Makefile for details
   Instructions to run the program:
     `./life --help` or `make run`/`make display`
 */
 
 #define _GNU_SOURCE
-// #define DEBUG0
-// #define DEBUG1
+#include "liblife.h"
+#include "tune_cache.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <math.h>
 #include <omp.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 // constants for arguments
 int WIDTH = 10;
 int HEIGHT = 10;
-int N;
 int GENERATIONS = 10;
 int P = 1;
 int Q = 1;
+int THREADS = 0;
 static int SHOW = false;
+static int TUNE = false;
+double TUNE_SECONDS = 10;
+char *CACHE = NULL;
+static int INPLACE = false;
+static int UNBOUNDED = false;
+int ENSEMBLE = 0;
+unsigned int SEED;
+char *OUTPUT = "ensemble.csv";
+char *BOARD_FILE = NULL;
+int BAND = 1024;
 
-// constants for program
-const int BORDER = 2;
-bool **BOARD;
-bool **NEWBOARD;
-bool **TEMP;
-
-int W_BORD;
-int H_BORD;
-int W_BOUND;
-int H_BOUND;
+void print_board(life_engine *engine) {
+  bool *board = life_cells(engine);
+  size_t stride = life_stride(engine);
+  printf("\033[H"); // return to home i.e. upper left
+  for (int x = 0; x < life_rows(engine); x++) {
+    for (int y = 0; y < life_cols(engine); y++) {
+      // inverted tile or empty
+      printf(board[x * stride + y] ? "\033[7m  \033[m" : "  ");
+    }
+    printf("\033[E"); // newline
+    fflush(stdout);
+  }
+};
 
-bool **create_2d_arr() {
-  bool **ptr = (bool **)malloc(W_BORD * sizeof(bool *));
-  if (ptr == NULL) {
+void play_game_of_life() {
+  // x * y tiles, one thread each unless THREADS; see liblife.c
+  life_engine *engine = life_create(HEIGHT, WIDTH, LIFE_OPENMP, INPLACE);
+  if (engine == NULL) {
     fprintf(stderr, "Allocating the initial board failed.\n");
+    exit(1);
   }
+  life_set_decomposition(engine, P, Q);
+  life_set_threads(engine, THREADS);
 
-  for (int i = 0; i < W_BORD; i++) {
-    ptr[i] = (bool *)malloc(H_BORD * sizeof(bool));
-    if (ptr[i] == NULL) {
-      fprintf(stderr, "Allocating the board row %d failed.\n", i);
+  // fill board randomly
+  bool *board = life_cells(engine);
+  size_t stride = life_stride(engine);
+  for (int x = 0; x < HEIGHT; x++) {
+    for (int y = 0; y < WIDTH; y++) {
+      board[x * stride + y] = rand() & 1;
     }
   }
-  return ptr;
-}
 
-void free_2d_arr(bool **arr) {
-  free(&arr[0][0]);
-  free(arr);
+  if (SHOW) {
+    for (int i = 0; i < GENERATIONS; i++) {
+      print_board(engine);
+      usleep(200000);
+      life_step(engine, 1);
+    }
+  } else {
+    life_step(engine, GENERATIONS);
+  }
+  life_destroy(engine);
 }
 
-void print_board() {
-  // depends on prep in play_game_of_life
-  // TODO: omit border of the dead?
-  printf("\033[H"); // return to home i.e. upper left
-  for (int x = 0; x < W_BORD; x++) {
-    for (int y = 0; y < H_BORD; y++) {
-      printf(BOARD[x][y] ? "\033[7m  \033[m" : "  "); // inverted tile or empty
+void play_unbounded() {
+  /* Random HEIGHT x WIDTH patch at the origin of an unbounded universe;
+   * --show watches that same window while the pattern may grow past it.
+   */
+  life_universe *universe = life_universe_create(LIFE_OPENMP);
+  if (universe == NULL) {
+    fprintf(stderr, "Allocating the universe failed.\n");
+    exit(1);
+  }
+  life_universe_set_threads(universe, THREADS > 0 ? THREADS : P * Q);
+  bool *view = malloc((size_t)HEIGHT * WIDTH * sizeof(bool));
+  for (int i = 0; i < HEIGHT * WIDTH; i++) {
+    view[i] = rand() & 1;
+  }
+  life_universe_set_region(universe, 0, 0, HEIGHT, WIDTH, view);
+
+  double t1 = omp_get_wtime();
+  for (int i = 0; i < GENERATIONS && SHOW; i++) {
+    life_universe_get_region(universe, 0, 0, HEIGHT, WIDTH, view);
+    printf("\033[H"); // return to home i.e. upper left
+    for (int x = 0; x < HEIGHT; x++) {
+      for (int y = 0; y < WIDTH; y++) {
+        // inverted tile or empty
+        printf(view[x * WIDTH + y] ? "\033[7m  \033[m" : "  ");
+      }
+      printf("\033[E"); // newline
     }
-    printf("\033[E"); // newline
     fflush(stdout);
+    usleep(200000);
+    life_universe_step(universe, 1);
   }
-};
+  if (!SHOW && life_universe_step(universe, GENERATIONS) != 0) {
+    fprintf(stderr, "Allocating a chunk failed.\n");
+    exit(1);
+  }
+  double t2 = omp_get_wtime() - t1;
 
-void progress_board() {
-  // depends on prep in play_game_of_life
-  int x, y, neighbors;
-
-#pragma omp parallel default(none) num_threads(P *Q)                           \
-    shared(BOARD, NEWBOARD, P, Q, N) private(x, y, neighbors)
-  {
-    int tid = omp_get_thread_num();
-    int p = tid / Q;
-    int q = tid % Q;
-    int myM = N / P;
-    int xstart = p * myM;
-    int xend = xstart + myM;
-    if ((tid == 0) | (xstart == 0)) {
-      xstart += 1;
+  long row0, col0, row1, col1;
+  printf("%d generations in %g s\n", GENERATIONS, t2);
+  printf("%ld cells alive in %ld chunks of 64x64\n",
+         life_universe_population(universe), life_universe_chunks(universe));
+  if (life_universe_bounds(universe, &row0, &col0, &row1, &col1)) {
+    printf("Live cells span rows %ld..%ld, columns %ld..%ld\n", row0, row1,
+           col0, col1);
+  }
+  free(view);
+  life_universe_destroy(universe);
+}
+
+bool load_tuning(const char *path) {
+  /* Lines are `width height inplace threads x y gens_per_second`. Take the
+   * entry for this board size, else the one closest in cell count within 4x.
+   */
+  FILE *in = fopen(path, "r");
+  if (in == NULL) {
+    return false;
+  }
+  char line[256];
+  double best = log(4.0);
+  bool found = false;
+  while (fgets(line, sizeof(line), in) != NULL) {
+    int w, h, inplace, threads, p, q;
+    double rate;
+    if (line[0] == '#' || sscanf(line, "%d %d %d %d %d %d %lf", &w, &h,
+                                 &inplace, &threads, &p, &q, &rate) != 7) {
+      continue;
     }
-    if (p >= P - 1) {
-      xend = N;
+    if (inplace != (INPLACE != 0)) {
+      continue;
     }
-#ifdef DEBUG1
-    printf("t: [%d]\n", tid);
-    printf("p: [%d/%d = %d]\n", tid, Q, p);
-    printf("q: [%d%%%d = %d]\n", tid, Q, q);
-    printf("m: [%d / %d = %d]\n", N, P, myM);
-    printf("s: [%d * %d = %d]\n", p, myM, xstart);
-    printf("e: [%d + %d = %d]\n", xstart, myM, xend);
-    printf("\n");
-#endif
-
-    for (x = xstart; x < xend; x++) {
-      int myN = N / Q;
-      int ystart = q * myN;
-      int yend = ystart + myN;
-      if ((tid == 0) | (ystart == 0)) {
-        ystart += 1;
-      }
-      if (q >= Q - 1) {
-        yend = N;
-      }
-#ifdef DEBUG1
-      printf("n: [%d / %d = %d]\n", N, Q, myN);
-      printf("s: [%d * %d = %d]\n", q, myN, ystart);
-      printf("e: [%d + %d = %d]\n", ystart, myN, yend);
-      printf("\n");
-#endif
-      for (y = ystart; y < yend; y++) {
-#ifdef DEBUG0
-        printf("xy:(%d,%d)\n", x, y);
-#endif
-        /* ordered like so:
-           123
-           4 5
-           678 */
-        // TODO: reduce to 3 memory accesses with int
-        neighbors = BOARD[x - 1][y - 1] + BOARD[x - 1][y] +
-                    BOARD[x - 1][y + 1] + BOARD[x][y - 1] + BOARD[x][y + 1] +
-                    BOARD[x + 1][y - 1] + BOARD[x + 1][y] + BOARD[x + 1][y + 1];
-
-        if (BOARD[x][y]) { // living cell rules
-          if (neighbors == 2 || neighbors == 3) {
-            NEWBOARD[x][y] = true; // remains alive
-          } else {
-            NEWBOARD[x][y] = false; // dead, over or under populated
-          }
-        } else { // dead cell rules
-          if (neighbors == 3) {
-            NEWBOARD[x][y] = true; // becomes alive
-          } else {
-            NEWBOARD[x][y] = false; // remains dead
-          }
+    double distance = fabs(log((double)w * h / ((double)WIDTH * HEIGHT)));
+    if (w == WIDTH && h == HEIGHT) {
+      distance = -1; // exact match always wins
+    }
+    if (distance <= best) {
+      best = distance;
+      P = p;
+      Q = q;
+      THREADS = threads;
+      found = true;
+    }
+  }
+  fclose(in);
+  return found;
+}
+
+void save_tuning(const char *path, double rate) {
+  // replace any entry for this board size and mode
+  char entry[256];
+  snprintf(entry, sizeof(entry), "%d %d %d %d %d %d %g", WIDTH, HEIGHT,
+           INPLACE != 0, THREADS, P, Q, rate);
+  if (tune_cache_save(path,
+                      "# width height inplace threads x y gens_per_second",
+                      entry, 3)) {
+    fprintf(stderr, "Writing the tuning cache %s failed.\n", path);
+  }
+}
+
+double time_candidate(life_engine *engine, const bool *initial, int threads,
+                      int p, int q, double budget, double *warm) {
+  /* Generations per second from the shared starting board. One warm
+   * generation sizes the timed run to about 50ms, or whatever is left of
+   * budget seconds if that is less.
+   */
+  life_set_region(engine, 0, 0, HEIGHT, WIDTH, initial);
+  life_set_decomposition(engine, p, q);
+  life_set_threads(engine, threads);
+
+  double t1 = omp_get_wtime();
+  life_step(engine, 1);
+  *warm = omp_get_wtime() - t1;
+  double span = budget - *warm < 0.05 ? budget - *warm : 0.05;
+  int gens = *warm > 0 ? span / *warm : 1000;
+  gens = gens < 1 ? 1 : gens > 1000 ? 1000 : gens;
+
+  t1 = omp_get_wtime();
+  life_step(engine, gens);
+  return gens / (omp_get_wtime() - t1);
+}
+
+void tune() {
+  /* Try thread counts (powers of two up to the core count, and the core
+   * count), each with every x * y tile grid of 1, 2 and 4 tiles per thread.
+   * Candidates run in that order, so the common one-tile-per-thread layouts
+   * come first. TUNE_SECONDS is a hard budget: past the first candidate,
+   * one is only run if two of the slowest generations seen so far (its warm
+   * one and at least one timed) fit in what is left.
+   */
+  int procs = omp_get_num_procs();
+  int counts[33];
+  int ncounts = 0;
+  counts[ncounts++] = procs;
+  for (int t = 1 << (int)log2(procs); t >= 1; t /= 2) {
+    if (t != procs) {
+      counts[ncounts++] = t;
+    }
+  }
+
+  double start = omp_get_wtime();
+  // one board, randomized once and restored before every candidate
+  life_engine *engine = life_create(HEIGHT, WIDTH, LIFE_OPENMP, INPLACE);
+  bool *initial = malloc((size_t)HEIGHT * WIDTH * sizeof(bool));
+  if (engine == NULL || initial == NULL) {
+    fprintf(stderr, "Allocating the calibration board failed.\n");
+    exit(1);
+  }
+  for (size_t i = 0; i < (size_t)HEIGHT * WIDTH; i += 16) {
+    int bits = rand(); // at least 16 random bits, one per cell
+    for (size_t j = i; j < i + 16 && j < (size_t)HEIGHT * WIDTH; j++) {
+      initial[j] = bits & 1;
+      bits >>= 1;
+    }
+  }
+
+  double best = 0;
+  double slowest = 0; // generation cost estimate for the next candidate
+  int best_threads = 1, best_p = 1, best_q = 1;
+  printf("%8s %4s %4s %14s\n", "threads", "x", "y", "gens/s");
+  for (int per = 1; per <= 4; per *= 2) {
+    for (int c = 0; c < ncounts; c++) {
+      int tiles = counts[c] * per;
+      for (int p = 1; p <= tiles; p++) {
+        if (tiles % p || p > HEIGHT || tiles / p > WIDTH) {
+          continue;
+        }
+        double left = TUNE_SECONDS - (omp_get_wtime() - start);
+        if (best > 0 && 2 * slowest > left) {
+          continue;
+        }
+        double warm;
+        double rate =
+            time_candidate(engine, initial, counts[c], p, tiles / p, left,
+                           &warm);
+        slowest = warm > slowest ? warm : slowest;
+        printf("%8d %4d %4d %14.2f\n", counts[c], p, tiles / p, rate);
+        if (rate > best) {
+          best = rate;
+          best_threads = counts[c];
+          best_p = p;
+          best_q = tiles / p;
         }
       }
     }
   }
-  TEMP = NEWBOARD;
-  NEWBOARD = BOARD;
-  BOARD = TEMP;
+  life_destroy(engine);
+  free(initial);
+
+  P = best_p;
+  Q = best_q;
+  THREADS = best_threads;
+  printf("Best: %d threads on %d x %d tiles, %.2f gens/s (%.1f s tuning)\n",
+         THREADS, P, Q, best, omp_get_wtime() - start);
+  save_tuning(CACHE, best);
+  printf("Saved to %s\n", CACHE);
 }
 
-void play_game_of_life() {
-  W_BORD = WIDTH + BORDER;
-  H_BORD = HEIGHT + BORDER;
-  W_BOUND = W_BORD - 1;
-  H_BOUND = H_BORD - 1;
-  N = W_BOUND;
+void play_ensemble() {
+  // ENSEMBLE independent boards, seeded SEED, SEED + 1, ...; see liblife.h
+  struct life_ensemble_result *results =
+      malloc(ENSEMBLE * sizeof(struct life_ensemble_result));
+  if (results == NULL || life_ensemble_run(ENSEMBLE, HEIGHT, WIDTH, SEED,
+                                           GENERATIONS, P * Q, results)) {
+    fprintf(stderr, "Allocating the ensemble arena failed.\n");
+    exit(1);
+  }
 
-  BOARD = create_2d_arr();
-  NEWBOARD = create_2d_arr();
+  FILE *out = fopen(OUTPUT, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Opening %s failed.\n", OUTPUT);
+    exit(1);
+  }
+  // period 0: no repeat within LIFE_MAX_PERIOD generations was seen
+  fprintf(out, "board,seed,population,period,detected_at\n");
+  for (int b = 0; b < ENSEMBLE; b++) {
+    fprintf(out, "%d,%u,%d,%d,%d\n", b, SEED + b, results[b].population,
+            results[b].period, results[b].detected_at);
+  }
+  fclose(out);
+  free(results);
+}
 
-  // fill board randomly
-  for (int x = 0; x < W_BORD; x++) {
-    for (int y = 0; y < H_BORD; y++) {
-      if (x == 0 || y == 0 || x == W_BOUND || y == H_BOUND) {
-        BOARD[x][y] = false; // border of the dead
-      } else {
-        BOARD[x][y] = rand() & 1;
+uint64_t *map_board(const char *path, size_t bytes, bool scratch,
+                    bool *kept) {
+  /* Shared file mapping of `bytes`. A board file is created if absent, and an
+   * existing one is used only if it is exactly `bytes` long, in which case
+   * *kept says its contents are the first generation. A scratch file must not
+   * exist yet, so no unrelated file is ever overwritten.
+   */
+  int fd = scratch ? -1 : open(path, O_RDWR);
+  *kept = fd >= 0;
+  if (fd < 0 && (scratch || errno == ENOENT)) {
+    fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+  }
+  if (fd < 0) {
+    fprintf(stderr, "Opening %s failed: %s.\n", path, strerror(errno));
+    exit(1);
+  }
+  struct stat st;
+  fstat(fd, &st);
+  if (*kept && (size_t)st.st_size != bytes) {
+    fprintf(stderr,
+            "%s is %lld bytes, not a %d x %d board (%zu bytes); not touching "
+            "it.\n",
+            path, (long long)st.st_size, HEIGHT, WIDTH, bytes);
+    exit(1);
+  }
+  if (!*kept && ftruncate(fd, bytes) != 0) {
+    fprintf(stderr, "Resizing %s failed.\n", path);
+    unlink(path);
+    exit(1);
+  }
+  uint64_t *map =
+      mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd); // the mapping keeps the file open
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Mapping %s failed.\n", path);
+    exit(1);
+  }
+  madvise(map, bytes, MADV_SEQUENTIAL);
+  return map;
+}
+
+void *rows_span(uint64_t *map, int words, long x0, long x1, bool inner,
+                size_t *len) {
+  /* Rows [x0, x1) of a mapping, widened to start on a page for madvise/msync.
+   * The kernel rounds the length up to whole pages; with inner the end is
+   * rounded down first, so the page holding row x1 is never included.
+   */
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t row_bytes = (size_t)words * sizeof(uint64_t);
+  size_t start = x0 * row_bytes / page * page;
+  size_t end = x1 * row_bytes;
+  if (inner) {
+    end = end / page * page;
+  }
+  *len = end > start ? end - start : 0;
+  return (char *)map + start;
+}
+
+bool storage_io(long long *read_bytes, long long *write_bytes) {
+  // bytes this process made the kernel fetch from/send to storage so far
+  FILE *in = fopen("/proc/self/io", "r");
+  char line[256];
+  int found = 0;
+  while (in != NULL && fgets(line, sizeof(line), in) != NULL) {
+    found += sscanf(line, "read_bytes: %lld", read_bytes);
+    found += sscanf(line, "write_bytes: %lld", write_bytes);
+  }
+  if (in != NULL) {
+    fclose(in);
+  }
+  return found == 2;
+}
+
+void play_out_of_core() {
+  /* Board of HEIGHT rows by WIDTH cells in BOARD_FILE, one bit per cell with
+   * rows padded to whole 64-bit words. Each generation reads one mapping and
+   * writes the other, BAND rows at a time: the kernel is asked to read ahead
+   * the next band while this one is computed, and finished bands are queued
+   * for writeback and dropped so resident memory stays around a few bands.
+   */
+  int words = (WIDTH + 63) / 64;
+  size_t bytes = (size_t)words * sizeof(uint64_t) * HEIGHT;
+  uint64_t lastmask = WIDTH % 64 ? (1ULL << (WIDTH % 64)) - 1 : ~0ULL;
+
+  char *next_file = malloc(strlen(BOARD_FILE) + sizeof(".next"));
+  sprintf(next_file, "%s.next", BOARD_FILE);
+  bool kept, unused;
+  if (access(next_file, F_OK) == 0) { // before BOARD_FILE might be created
+    fprintf(stderr, "%s already exists; remove it if it is left over from an "
+                    "earlier run.\n",
+            next_file);
+    exit(1);
+  }
+  uint64_t *src = map_board(BOARD_FILE, bytes, false, &kept);
+  uint64_t *dst = map_board(next_file, bytes, true, &unused);
+  if (!kept) { // fill board randomly
+    for (long x = 0; x < HEIGHT; x++) {
+      uint64_t *row = src + x * words;
+      for (int i = 0; i < words; i++) {
+        row[i] = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
       }
+      row[words - 1] &= lastmask;
     }
+    msync(src, bytes, MS_SYNC);
   }
 
+  long alive = 0;
+  long long read0 = 0, write0 = 0, read1 = 0, write1 = 0;
+  bool have_io = storage_io(&read0, &write0);
+  double t1 = omp_get_wtime();
   for (int i = 0; i < GENERATIONS; i++) {
-    if (SHOW) {
-      print_board();
-      usleep(200000);
+    alive = 0;
+    size_t len;
+    void *span = rows_span(src, words, 0, BAND < HEIGHT ? BAND : HEIGHT, false,
+                           &len);
+    madvise(span, len, MADV_WILLNEED);
+    for (long x0 = 0; x0 < HEIGHT; x0 += BAND) {
+      long x1 = x0 + BAND < HEIGHT ? x0 + BAND : HEIGHT;
+      // overlap: start reading the next band (plus its lower halo row)
+      long x2 = x1 + BAND + 1 < HEIGHT ? x1 + BAND + 1 : HEIGHT;
+      span = rows_span(src, words, x1, x2, false, &len);
+      madvise(span, len, MADV_WILLNEED);
+
+#pragma omp parallel for num_threads(P *Q) reduction(+ : alive)
+      for (long x = x0; x < x1; x++) {
+        uint64_t *out = dst + x * words;
+        life_packed_step_row(x > 0 ? src + (x - 1) * words : NULL,
+                             src + x * words,
+                             x < HEIGHT - 1 ? src + (x + 1) * words : NULL,
+                             out, words, lastmask);
+        for (int w = 0; w < words; w++) {
+          alive += __builtin_popcountll(out[w]);
+        }
+      }
+
+      // start writeback of the finished band, then let go of it
+      span = rows_span(dst, words, x0, x1, false, &len);
+      msync(span, len, MS_ASYNC);
+      span = rows_span(dst, words, x0, x1, true, &len);
+      madvise(span, len, MADV_DONTNEED);
+      // the next band still needs row x1 - 1 as its upper halo
+      span = rows_span(src, words, x0, x1 - 1, true, &len);
+      madvise(span, len, MADV_DONTNEED);
     }
-    progress_board();
+    uint64_t *temp = src;
+    src = dst;
+    dst = temp;
+  }
+  msync(src, bytes, MS_SYNC);
+  double t2 = omp_get_wtime() - t1;
+  have_io = storage_io(&read1, &write1) && have_io;
+
+  munmap(src, bytes);
+  munmap(dst, bytes);
+  // every generation ends in src; make sure that is BOARD_FILE
+  if (GENERATIONS % 2) {
+    rename(next_file, BOARD_FILE);
+  } else {
+    unlink(next_file);
   }
-  free_2d_arr(BOARD);
-  free_2d_arr(NEWBOARD);
+
+  printf("%d generations of %d rows x %d columns in %g s\n", GENERATIONS,
+         HEIGHT, WIDTH, t2);
+  // what actually hit storage; pages already cached cost no reads
+  if (have_io) {
+    double read = (read1 - read0) / 1e6, written = (write1 - write0) / 1e6;
+    printf("Band of %d rows, %.1f MB read and %.1f MB written, %.1f MB/s\n",
+           BAND, read, written, (read + written) / t2);
+  } else {
+    printf("Band of %d rows, storage I/O unknown without /proc/self/io\n",
+           BAND);
+  }
+  if (GENERATIONS > 0) {
+    printf("%ld cells alive\n", alive);
+  }
+  free(next_file);
 }
 
 int main(int argc, char **argv) {
@@ -193,10 +500,24 @@ int main(int argc, char **argv) {
       {"width", required_argument, 0, 'w'},
       {"height", required_argument, 0, 'h'},
       {"generations", required_argument, 0, 'g'},
+      {"inplace", no_argument, &INPLACE, 'i'},
+      {"ensemble", required_argument, 0, 'e'},
+      {"seed", required_argument, 0, 'r'},
+      {"output", required_argument, 0, 'o'},
+      {"threads", required_argument, 0, 't'},
+      {"tune", no_argument, &TUNE, 'T'},
+      {"tune-seconds", required_argument, 0, 'S'},
+      {"cache", required_argument, 0, 'C'},
+      {"unbounded", no_argument, &UNBOUNDED, 'u'},
+      {"file", required_argument, 0, 'f'},
+      {"band", required_argument, 0, 'b'},
+      {0, 0, 0, 0},
   };
 
-  while ((c = getopt_long(argc, argv, "Hw:h:g:x:y:s", long_options,
-                          &option_index)) != -1) {
+  bool decomposed = false; // explicit -x/-y/-t beat the tuning cache
+  SEED = time(NULL);
+  while ((c = getopt_long(argc, argv, "Hw:h:g:x:y:t:TS:C:siue:r:o:f:b:",
+                          long_options, &option_index)) != -1) {
     switch (c) {
     case 'H':
       printf("\n");
@@ -214,10 +535,46 @@ int main(int argc, char **argv) {
       printf("\t\t-y/--decomp-y: Set y dimension for board decomposition in "
              "parallelization.\n");
       printf("\t\t\t Defaults to 1.\n");
+      printf("\t\t-t/--threads: Share the x * y tiles among this many "
+             "threads.\n");
+      printf("\t\t\t Defaults to one thread per tile.\n");
+      printf("\t\t-T/--tune: Time candidate thread counts and tile grids on\n");
+      printf("\t\t\t this board size, save the fastest to the cache and\n");
+      printf("\t\t\t run with it. Without -x, -y or -t, later runs load\n");
+      printf("\t\t\t the cached choice for the closest board size.\n");
+      printf("\t\t-S/--tune-seconds: Stop trying candidates after this "
+             "long.\n");
+      printf("\t\t\t Defaults to 10.\n");
+      printf("\t\t-C/--cache: Tuning cache file.\n");
+      printf("\t\t\t Defaults to ~/.cache/life_openmp.<hostname>.\n");
       printf("\t\t-s/--show: Show the simulation.\n");
       printf("\t\t\t Defaults to False.\n");
       printf("\t\t\t The simulation will run slower for viewing purposes.\n");
       printf("\t\t\t Avoid using a board larger than your viewport.\n");
+      printf("\t\t-i/--inplace: Update the board in place.\n");
+      printf("\t\t\t Defaults to False. Each thread keeps a few rows of\n");
+      printf("\t\t\t its tile instead of a second board, halving memory.\n");
+      printf("\t\t-e/--ensemble: Simulate this many independent boards.\n");
+      printf("\t\t\t Defaults to 0 (one board, no ensemble).\n");
+      printf("\t\t\t Uses x * y threads; writes per-board population and\n");
+      printf("\t\t\t period (0 if none within %d gens) to --output.\n",
+             LIFE_MAX_PERIOD);
+      printf("\t\t-r/--seed: Seed of board 0; board i uses seed + i.\n");
+      printf("\t\t\t Defaults to the current time.\n");
+      printf("\t\t-o/--output: Ensemble results file.\n");
+      printf("\t\t\t Defaults to ensemble.csv.\n");
+      printf("\t\t-f/--file: Keep the board in this file instead of RAM.\n");
+      printf("\t\t\t One bit per cell, rows padded to 64 bits; an existing\n");
+      printf("\t\t\t file of the right size is used as the first\n");
+      printf("\t\t\t generation, any other size is refused. Holds the last\n");
+      printf("\t\t\t generation afterwards. FILE.next is scratch space and\n");
+      printf("\t\t\t must not exist.\n");
+      printf("\t\t-b/--band: Rows streamed at a time with --file.\n");
+      printf("\t\t\t Defaults to 1024.\n");
+      printf("\t\t-u/--unbounded: Start from a random width x height patch\n");
+      printf("\t\t\t in a universe without edges, stored as 64x64 chunks\n");
+      printf("\t\t\t that come and go with the live cells. Uses x * y\n");
+      printf("\t\t\t threads, or -t.\n");
       printf("\n");
       printf("\t\tExample:\n");
       printf("\t\t\t./life -h 15 -w 20 -g 10 -s\n");
@@ -225,6 +582,9 @@ int main(int argc, char **argv) {
       printf("\t\tExample with threading:\n");
       printf("\t\t\t./life -h 500 -w 500 -g 500 -t 16 -x 4 -y 4\n");
       printf("\n");
+      printf("\t\tExample ensemble:\n");
+      printf("\t\t\t./life_openmp -h 64 -w 64 -g 1000 -e 4096 -x 4\n");
+      printf("\n");
       exit(0);
     case 'w':
       WIDTH = atoi(optarg);
@@ -237,22 +597,82 @@ int main(int argc, char **argv) {
       break;
     case 'x':
       P = atoi(optarg);
+      decomposed = true;
       break;
     case 'y':
       Q = atoi(optarg);
+      decomposed = true;
+      break;
+    case 't':
+      THREADS = atoi(optarg);
+      decomposed = true;
+      break;
+    case 'T':
+      TUNE = true;
+      break;
+    case 'S':
+      TUNE_SECONDS = atof(optarg);
+      break;
+    case 'C':
+      CACHE = optarg;
       break;
     case 's':
       SHOW = true;
       break;
+    case 'i':
+      INPLACE = true;
+      break;
+    case 'u':
+      UNBOUNDED = true;
+      break;
+    case 'e':
+      ENSEMBLE = atoi(optarg);
+      break;
+    case 'r':
+      SEED = strtoul(optarg, NULL, 10);
+      break;
+    case 'o':
+      OUTPUT = optarg;
+      break;
+    case 'f':
+      BOARD_FILE = optarg;
+      break;
+    case 'b':
+      BAND = atoi(optarg);
+      break;
     }
   }
 
-  if (WIDTH != HEIGHT) {
-    printf("Inequal WIDTH and HEIGHT provided, which is not supported.\n");
-    printf("Shutting down...");
-    exit(1);
+  if (BOARD_FILE != NULL) {
+    if (BAND < 1) {
+      printf("Band must be at least one row.\n");
+      exit(1);
+    }
+    srand(SEED);
+    play_out_of_core();
+    return 0;
   }
 
-  srand(time(NULL));
+  if (UNBOUNDED) {
+    srand(SEED);
+    play_unbounded();
+    return 0;
+  }
+
+  if (ENSEMBLE > 0) {
+    play_ensemble();
+    return 0;
+  }
+
+  srand(SEED);
+  if (CACHE == NULL && (CACHE = tune_cache_path("life_openmp")) == NULL) {
+    fprintf(stderr, "Allocating the tuning cache path failed.\n");
+    exit(1);
+  }
+  if (TUNE) {
+    tune();
+  } else if (!decomposed) {
+    load_tuning(CACHE);
+  }
   play_game_of_life();
 }
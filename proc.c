@@ -12,14 +12,47 @@
 */
 
 #define _GNU_SOURCE
-#include <assert.h>
+#include <getopt.h>
+#include <limits.h>
 #include <mpi.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
+// constants for arguments
+int WARMUP = 2;
+int ITERATIONS = 100;
+int MIN_EXP = 5;
+int MAX_EXP = 20;
+int ROTATE = 1;
+long FLUSH_BYTES = 0;
+long SEGMENT_BYTES = 64 * 1024;
+MPI_Datatype ELEM_TYPE;
+static int CSV = false;
 
-const int TIMES_TO_TEST = 1;
+// constants for program
+char *FLUSHBUF = NULL;
+const int BRUCK_MAX_BYTES = 256; // per-block cutoff for Bruck in alltoall
+const long BCAST_PIPELINE_BYTES = 128 * 1024; // chain above, binomial below
+
+struct hierarchy {
+  /* Communicators for the two-level broadcast, rebuilt when comm/root change.
+   * node: processes sharing memory with us.
+   * leaders: one process per node, with root's as rank 0.
+   */
+  MPI_Comm comm;
+  int root;
+  MPI_Comm node;
+  MPI_Comm leaders;
+  int node_leader; // rank in `node` that talks to the other nodes
+  MPI_Win win;     // node-shared staging buffer owned by node_leader
+  long win_bytes;
+  char *shared;
+};
+struct hierarchy HIER = {MPI_COMM_NULL, -1, MPI_COMM_NULL, MPI_COMM_NULL,
+                         0,             MPI_WIN_NULL, 0, NULL};
 
 void mygather(void *sendbuf, int sendcount, MPI_Datatype sendtype,
               void *recvbuf, int recvcount, MPI_Datatype recvtype, int root,
@@ -59,6 +92,7 @@ void mybcast(void *buf, int count, MPI_Datatype type, int root,
              MPI_Comm communicator) {
   /* Copy one element to all processes
    * Tag is irrelevant; always 0 in this communication
+   * Root sends to each process in turn, so this is linear in size.
    * */
   int rank;
   MPI_Comm_rank(communicator, &rank);
@@ -67,26 +101,205 @@ void mybcast(void *buf, int count, MPI_Datatype type, int root,
 
   MPI_Request *sreqs = malloc(size * sizeof(MPI_Request));
   MPI_Request rreq;
-  MPI_Status *send_stats = malloc(size * sizeof(MPI_Status));
   MPI_Status recv_stat;
 
   if (size == 0) {
     free(sreqs);
-    free(send_stats);
     return;
   }
 
   if (rank == root) { // root sends to all other procs
-    for (int i = 1; i < size; i++) {
-      MPI_Isend(buf, count * size, type, i, 0, communicator, &sreqs[i]);
-      MPI_Wait(&sreqs[i], &send_stats[i]);
+    int nreqs = 0;
+    for (int i = 0; i < size; i++) {
+      if (i != root) {
+        MPI_Isend(buf, count, type, i, 0, communicator, &sreqs[nreqs++]);
+      }
     }
+    MPI_Waitall(nreqs, sreqs, MPI_STATUSES_IGNORE);
   } else { // all other procs wait for root
-    MPI_Irecv(buf, count * size, type, root, 0, communicator, &rreq);
+    MPI_Irecv(buf, count, type, root, 0, communicator, &rreq);
     MPI_Wait(&rreq, &recv_stat);
   }
   free(sreqs);
-  free(send_stats);
+}
+
+void binomial_bcast(void *buf, int count, MPI_Datatype type, int root,
+                    MPI_Comm communicator) {
+  /* Every process that has the data forwards it, doubling the holders each
+   * round: ceil(log2(size)) rounds. Ranks are taken relative to root.
+   * Receive from the parent that differs in our lowest set bit, then send to
+   * children at each lower bit.
+   */
+  int rank;
+  MPI_Comm_rank(communicator, &rank);
+  int size;
+  MPI_Comm_size(communicator, &size);
+  int vrank = (rank - root + size) % size;
+
+  int mask = 1;
+  while (mask < size) {
+    if (vrank & mask) {
+      int parent = (vrank - mask + root) % size;
+      MPI_Recv(buf, count, type, parent, 0, communicator, MPI_STATUS_IGNORE);
+      break;
+    }
+    mask <<= 1;
+  }
+  mask >>= 1;
+  while (mask > 0) {
+    if (vrank + mask < size) {
+      int child = (vrank + mask + root) % size;
+      MPI_Send(buf, count, type, child, 0, communicator);
+    }
+    mask >>= 1;
+  }
+}
+
+void chain_bcast(void *buf, int count, MPI_Datatype type, int root,
+                 MPI_Comm communicator) {
+  /* Pass the buffer down a chain root -> root+1 -> ... in SEGMENT_BYTES
+   * pieces. Forwarding segment k overlaps receiving segment k+1, so for large
+   * messages the time approaches one message transfer plus (size - 2)
+   * segment transfers instead of size - 1 full transfers.
+   */
+  int rank;
+  MPI_Comm_rank(communicator, &rank);
+  int size;
+  MPI_Comm_size(communicator, &size);
+  int type_s;
+  MPI_Type_size(type, &type_s);
+  int vrank = (rank - root + size) % size;
+  int prev = (rank - 1 + size) % size;
+  int next = (rank + 1) % size;
+
+  int seg = SEGMENT_BYTES / type_s;
+  if (seg < 1)
+    seg = 1;
+  int nsegs = (count + seg - 1) / seg;
+  MPI_Request *sreqs = malloc(nsegs * sizeof(MPI_Request));
+  int nreqs = 0;
+
+  /* One tag for every segment: messages between two ranks never overtake
+   * each other, and k can pass 32767, the largest tag MPI guarantees.
+   */
+  for (int k = 0; k < nsegs; k++) {
+    long offset = (long)k * seg;
+    int n = (offset + seg > count) ? count - offset : seg;
+    if (vrank > 0) {
+      MPI_Recv(buf + offset * type_s, n, type, prev, 0, communicator,
+               MPI_STATUS_IGNORE);
+    }
+    if (vrank < size - 1) {
+      MPI_Isend(buf + offset * type_s, n, type, next, 0, communicator,
+                &sreqs[nreqs++]);
+    }
+  }
+  MPI_Waitall(nreqs, sreqs, MPI_STATUSES_IGNORE);
+  free(sreqs);
+}
+
+void bcast(void *buf, int count, MPI_Datatype type, int root,
+           MPI_Comm communicator) {
+  /* The tree wins while latency dominates; the chain wins once the message
+   * is long enough to keep every link busy.
+   */
+  int type_s;
+  MPI_Type_size(type, &type_s);
+  if ((long)count * type_s < BCAST_PIPELINE_BYTES) {
+    binomial_bcast(buf, count, type, root, communicator);
+  } else {
+    chain_bcast(buf, count, type, root, communicator);
+  }
+}
+
+void free_hierarchy() {
+  if (HIER.win != MPI_WIN_NULL) {
+    MPI_Win_unlock_all(HIER.win);
+    MPI_Win_free(&HIER.win);
+  }
+  if (HIER.leaders != MPI_COMM_NULL)
+    MPI_Comm_free(&HIER.leaders);
+  if (HIER.node != MPI_COMM_NULL)
+    MPI_Comm_free(&HIER.node);
+  HIER.comm = MPI_COMM_NULL;
+  HIER.root = -1;
+  HIER.win_bytes = 0;
+  HIER.shared = NULL;
+}
+
+void setup_hierarchy(int root, long bytes, MPI_Comm communicator) {
+  /* Splitting communicators and allocating windows is far slower than the
+   * broadcast itself, so keep them around between calls.
+   */
+  int rank;
+  MPI_Comm_rank(communicator, &rank);
+
+  if (HIER.comm != communicator || HIER.root != root) {
+    free_hierarchy();
+    HIER.comm = communicator;
+    HIER.root = root;
+    MPI_Comm_split_type(communicator, MPI_COMM_TYPE_SHARED, rank,
+                        MPI_INFO_NULL, &HIER.node);
+    int node_rank;
+    MPI_Comm_rank(HIER.node, &node_rank);
+
+    // root leads its own node; elsewhere the lowest node rank does
+    int is_root = rank == root;
+    int root_here;
+    MPI_Allreduce(&is_root, &root_here, 1, MPI_INT, MPI_MAX, HIER.node);
+    bool leader = root_here ? is_root : node_rank == 0;
+    int leader_rank = leader ? node_rank : -1;
+    MPI_Allreduce(&leader_rank, &HIER.node_leader, 1, MPI_INT, MPI_MAX,
+                  HIER.node);
+    MPI_Comm_split(communicator, leader ? 0 : MPI_UNDEFINED,
+                   is_root ? -1 : rank, &HIER.leaders);
+  }
+
+  if (HIER.win_bytes < bytes) {
+    if (HIER.win != MPI_WIN_NULL) {
+      MPI_Win_unlock_all(HIER.win);
+      MPI_Win_free(&HIER.win);
+    }
+    int node_rank;
+    MPI_Comm_rank(HIER.node, &node_rank);
+    MPI_Aint mine = node_rank == HIER.node_leader ? bytes : 0;
+    void *base;
+    MPI_Win_allocate_shared(mine, 1, MPI_INFO_NULL, HIER.node, &base,
+                            &HIER.win);
+    MPI_Aint win_size;
+    int disp_unit;
+    MPI_Win_shared_query(HIER.win, HIER.node_leader, &win_size, &disp_unit,
+                         &HIER.shared);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, HIER.win);
+    HIER.win_bytes = bytes;
+  }
+}
+
+void twolevel_bcast(void *buf, int count, MPI_Datatype type, int root,
+                    MPI_Comm communicator) {
+  /* 1. Node leaders broadcast among themselves; only they cross the network.
+   * 2. Each leader copies into a node-shared window and the rest of the node
+   *    copies straight out of it, with no messages at all.
+   */
+  int type_s;
+  MPI_Type_size(type, &type_s);
+  long bytes = (long)count * type_s;
+  setup_hierarchy(root, bytes, communicator);
+  int node_rank;
+  MPI_Comm_rank(HIER.node, &node_rank);
+
+  if (HIER.leaders != MPI_COMM_NULL) {
+    bcast(buf, count, type, 0, HIER.leaders);
+    memcpy(HIER.shared, buf, bytes);
+  }
+  MPI_Win_sync(HIER.win);
+  MPI_Barrier(HIER.node);
+  MPI_Win_sync(HIER.win);
+  if (node_rank != HIER.node_leader) {
+    memcpy(buf, HIER.shared, bytes);
+  }
+  // leader must not refill the window until everyone has read it
+  MPI_Barrier(HIER.node);
 }
 
 void allgather(void *sendbuf, int sendcount, MPI_Datatype sendtype,
@@ -106,61 +319,519 @@ void allgather(void *sendbuf, int sendcount, MPI_Datatype sendtype,
   mygather(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, 0,
            communicator);
   // root sends all messages to all others
-  mybcast(recvbuf, recvcount, recvtype, 0, communicator);
+  bcast(recvbuf, recvcount * size, recvtype, 0, communicator);
 }
-void pairwise() {}
 
-int power(int base, int exp) {
-  int temp = base;
-  for (int i = 1; i < exp; i++) {
-    base *= temp;
+void pairwise(void *sendbuf, int sendcount, MPI_Datatype sendtype,
+              void *recvbuf, int recvcount, MPI_Datatype recvtype,
+              MPI_Comm communicator) {
+  /* Personalized all-to-all: block i of sendbuf goes to process i.
+   * Step i exchanges exactly one block with one partner, so every link carries
+   * a full message per step; good for large messages.
+   * Power of two sizes pair up as rank ^ i; otherwise send to rank + i while
+   * receiving from rank - i.
+   */
+  int rank;
+  MPI_Comm_rank(communicator, &rank);
+  int size;
+  MPI_Comm_size(communicator, &size);
+  int sendtype_s, recvtype_s;
+  MPI_Type_size(sendtype, &sendtype_s);
+  MPI_Type_size(recvtype, &recvtype_s);
+  long sendblock = (long)sendcount * sendtype_s;
+  long recvblock = (long)recvcount * recvtype_s;
+  bool pow2 = (size & (size - 1)) == 0;
+
+  memcpy(recvbuf + rank * recvblock, sendbuf + rank * sendblock, sendblock);
+  for (int i = 1; i < size; i++) {
+    int sendto, recvfrom;
+    if (pow2) {
+      sendto = recvfrom = rank ^ i;
+    } else {
+      sendto = (rank + i) % size;
+      recvfrom = (rank - i + size) % size;
+    }
+    MPI_Sendrecv(sendbuf + sendto * sendblock, sendcount, sendtype, sendto, 0,
+                 recvbuf + recvfrom * recvblock, recvcount, recvtype, recvfrom,
+                 0, communicator, MPI_STATUS_IGNORE);
   }
-  return base;
 }
 
-int main(int argc, char **argv) {
-  double t1, t2;
-  int *sendbuf = NULL;
-  int *recvbuf = NULL;
+void bruck(void *sendbuf, int sendcount, MPI_Datatype sendtype, void *recvbuf,
+           int recvcount, MPI_Datatype recvtype, MPI_Comm communicator) {
+  /* Personalized all-to-all in ceil(log2(p)) steps; good for small messages.
+   * 1. Rotate so local block i is the one bound for rank + i.
+   * 2. At step k, every block whose index has bit k set moves to rank + k.
+   * 3. Block i now came from rank - i; rotate back into place.
+   *
+   * NOTE: we can assume sendtype == recvtype, sendcount == recvcount
+   */
+  int rank;
+  MPI_Comm_rank(communicator, &rank);
+  int size;
+  MPI_Comm_size(communicator, &size);
+  int recvtype_s;
+  MPI_Type_size(recvtype, &recvtype_s);
+  long block = (long)recvcount * recvtype_s;
 
-  int rank, size;
-  MPI_Init(NULL, NULL);
-  MPI_Comm_size(MPI_COMM_WORLD, &size);
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  char *tmp = malloc(size * block);
+  char *packbuf = malloc(((size + 1) / 2) * block);
+  char *unpackbuf = malloc(((size + 1) / 2) * block);
+  if (tmp == NULL || packbuf == NULL || unpackbuf == NULL) {
+    fprintf(stderr, "Allocating the Bruck buffers failed.\n");
+    MPI_Abort(communicator, 1);
+  }
+
+  for (int i = 0; i < size; i++) {
+    memcpy(tmp + i * block, sendbuf + ((rank + i) % size) * block, block);
+  }
+
+  for (int k = 1; k < size; k <<= 1) {
+    int sendto = (rank + k) % size;
+    int recvfrom = (rank - k + size) % size;
+    int nblocks = 0;
+    for (int i = 0; i < size; i++) {
+      if (i & k) {
+        memcpy(packbuf + nblocks * block, tmp + i * block, block);
+        nblocks++;
+      }
+    }
+    MPI_Sendrecv(packbuf, nblocks * recvcount, recvtype, sendto, 0, unpackbuf,
+                 nblocks * recvcount, recvtype, recvfrom, 0, communicator,
+                 MPI_STATUS_IGNORE);
+    nblocks = 0;
+    for (int i = 0; i < size; i++) {
+      if (i & k) {
+        memcpy(tmp + i * block, unpackbuf + nblocks * block, block);
+        nblocks++;
+      }
+    }
+  }
+
+  for (int j = 0; j < size; j++) {
+    memcpy(recvbuf + j * block, tmp + ((rank - j + size) % size) * block,
+           block);
+  }
+  free(tmp);
+  free(packbuf);
+  free(unpackbuf);
+}
+
+void alltoall(void *sendbuf, int sendcount, MPI_Datatype sendtype,
+              void *recvbuf, int recvcount, MPI_Datatype recvtype,
+              MPI_Comm communicator) {
+  /* Bruck trades extra copies for fewer messages; only worth it while
+   * per-message latency dominates.
+   */
+  int sendtype_s;
+  MPI_Type_size(sendtype, &sendtype_s);
+  if ((long)sendcount * sendtype_s <= BRUCK_MAX_BYTES) {
+    bruck(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype,
+          communicator);
+  } else {
+    pairwise(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype,
+             communicator);
+  }
+}
+
+struct collective {
+  /* A timed operation in the sweep.
+   * send_scale/recv_scale are how many `count`-sized blocks the send and recv
+   * buffers hold; 0 means one block per process.
+   */
+  const char *name;
+  void (*run)(void *sendbuf, void *recvbuf, int count, MPI_Datatype type,
+              MPI_Comm communicator);
+  int send_scale;
+  int recv_scale;
+  long (*expect)(long m, int count, int rank, int size);
+};
+
+long expect_gathered(long m, int count, int rank, int size) { return m; }
+
+long expect_exchanged(long m, int count, int rank, int size) {
+  // block j came from rank j, which filled it as its block `rank`
+  long j = m / count;
+  return (j * size + rank) * count + m % count;
+}
+
+void run_allgather(void *sendbuf, void *recvbuf, int count, MPI_Datatype type,
+                   MPI_Comm communicator) {
+  allgather(sendbuf, count, type, recvbuf, count, type, communicator);
+}
+
+void run_pairwise(void *sendbuf, void *recvbuf, int count, MPI_Datatype type,
+                  MPI_Comm communicator) {
+  pairwise(sendbuf, count, type, recvbuf, count, type, communicator);
+}
+
+void run_bruck(void *sendbuf, void *recvbuf, int count, MPI_Datatype type,
+               MPI_Comm communicator) {
+  bruck(sendbuf, count, type, recvbuf, count, type, communicator);
+}
+
+void run_alltoall(void *sendbuf, void *recvbuf, int count, MPI_Datatype type,
+                  MPI_Comm communicator) {
+  alltoall(sendbuf, count, type, recvbuf, count, type, communicator);
+}
+
+void run_mpi_alltoall(void *sendbuf, void *recvbuf, int count,
+                      MPI_Datatype type, MPI_Comm communicator) {
+  MPI_Alltoall(sendbuf, count, type, recvbuf, count, type, communicator);
+}
+
+void copy_root(void *sendbuf, void *recvbuf, int count, MPI_Datatype type,
+               MPI_Comm communicator) {
+  // broadcasts work in place; the root starts out holding its send data
+  int rank, type_s;
+  MPI_Comm_rank(communicator, &rank);
+  MPI_Type_size(type, &type_s);
+  if (rank == 0) {
+    memcpy(recvbuf, sendbuf, (size_t)count * type_s);
+  }
+}
+
+void run_linear_bcast(void *sendbuf, void *recvbuf, int count,
+                      MPI_Datatype type, MPI_Comm communicator) {
+  copy_root(sendbuf, recvbuf, count, type, communicator);
+  mybcast(recvbuf, count, type, 0, communicator);
+}
+
+void run_binomial_bcast(void *sendbuf, void *recvbuf, int count,
+                        MPI_Datatype type, MPI_Comm communicator) {
+  copy_root(sendbuf, recvbuf, count, type, communicator);
+  binomial_bcast(recvbuf, count, type, 0, communicator);
+}
+
+void run_chain_bcast(void *sendbuf, void *recvbuf, int count,
+                     MPI_Datatype type, MPI_Comm communicator) {
+  copy_root(sendbuf, recvbuf, count, type, communicator);
+  chain_bcast(recvbuf, count, type, 0, communicator);
+}
+
+void run_twolevel_bcast(void *sendbuf, void *recvbuf, int count,
+                        MPI_Datatype type, MPI_Comm communicator) {
+  copy_root(sendbuf, recvbuf, count, type, communicator);
+  twolevel_bcast(recvbuf, count, type, 0, communicator);
+}
+
+void run_mpi_bcast(void *sendbuf, void *recvbuf, int count, MPI_Datatype type,
+                   MPI_Comm communicator) {
+  copy_root(sendbuf, recvbuf, count, type, communicator);
+  MPI_Bcast(recvbuf, count, type, 0, communicator);
+}
+
+const struct collective COLLECTIVES[] = {
+    {"allgather", run_allgather, 1, 0, expect_gathered},
+    {"pairwise", run_pairwise, 0, 0, expect_exchanged},
+    {"bruck", run_bruck, 0, 0, expect_exchanged},
+    {"alltoall", run_alltoall, 0, 0, expect_exchanged},
+    {"MPI_Alltoall", run_mpi_alltoall, 0, 0, expect_exchanged},
+    {"linear_bcast", run_linear_bcast, 1, 1, expect_gathered},
+    {"binomial_bcast", run_binomial_bcast, 1, 1, expect_gathered},
+    {"chain_bcast", run_chain_bcast, 1, 1, expect_gathered},
+    {"twolevel_bcast", run_twolevel_bcast, 1, 1, expect_gathered},
+    {"MPI_Bcast", run_mpi_bcast, 1, 1, expect_gathered},
+};
+const int N_COLLECTIVES = sizeof(COLLECTIVES) / sizeof(COLLECTIVES[0]);
+
+MPI_Datatype parse_type(const char *name) {
+  if (strcmp(name, "char") == 0)
+    return MPI_CHAR;
+  if (strcmp(name, "int") == 0)
+    return MPI_INT;
+  if (strcmp(name, "long") == 0)
+    return MPI_LONG;
+  if (strcmp(name, "double") == 0)
+    return MPI_DOUBLE;
+  fprintf(stderr, "Unknown element type '%s'.\n", name);
+  exit(1);
+}
+
+const char *type_name(MPI_Datatype type) {
+  if (type == MPI_CHAR)
+    return "char";
+  if (type == MPI_LONG)
+    return "long";
+  if (type == MPI_DOUBLE)
+    return "double";
+  return "int";
+}
+
+void set_elem(void *buf, MPI_Datatype type, long i, long value) {
+  if (type == MPI_CHAR)
+    ((char *)buf)[i] = (char)value;
+  else if (type == MPI_LONG)
+    ((long *)buf)[i] = value;
+  else if (type == MPI_DOUBLE)
+    ((double *)buf)[i] = (double)value;
+  else
+    ((int *)buf)[i] = (int)value;
+}
+
+bool elem_equals(void *buf, MPI_Datatype type, long i, long value) {
+  // compare after the same narrowing set_elem applies, so char wraps cleanly
+  if (type == MPI_CHAR)
+    return ((char *)buf)[i] == (char)value;
+  if (type == MPI_LONG)
+    return ((long *)buf)[i] == value;
+  if (type == MPI_DOUBLE)
+    return ((double *)buf)[i] == (double)value;
+  return ((int *)buf)[i] == (int)value;
+}
+
+int blocks(int scale, int size) { return scale == 0 ? size : scale; }
+
+void fill_sendbuf(const struct collective *op, void *buf, int count, int rank,
+                  int size) {
+  /* Element j of block b on rank r is (r * nblocks + b) * count + j, so
+   * gathering everything in rank order counts up from zero.
+   */
+  int nblocks = blocks(op->send_scale, size);
+  for (long j = 0; j < (long)count * nblocks; j++) {
+    set_elem(buf, ELEM_TYPE, j, j + (long)count * nblocks * rank);
+  }
+}
+
+bool check_recvbuf(const struct collective *op, void *buf, int count, int rank,
+                   int size) {
+  long n = (long)count * blocks(op->recv_scale, size);
+  for (long m = 0; m < n; m++) {
+    if (!elem_equals(buf, ELEM_TYPE, m, op->expect(m, count, rank, size))) {
+      return false;
+    }
+  }
+  return true;
+}
 
-  int msgsize = 0;
+void flush_cache() {
+  // write through a buffer larger than the LLC so each iteration starts cold
+  if (FLUSHBUF == NULL) {
+    return;
+  }
+  for (long i = 0; i < FLUSH_BYTES; i += 64) {
+    FLUSHBUF[i] += 1;
+  }
+}
+
+int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
 
-  for (int i = 5; i <= 20; i++) {
-    msgsize = power(2, i);
-    sendbuf = (int *)calloc(msgsize, sizeof(int));
-    for (int j = 0; j < msgsize; j++) {
-      sendbuf[j] = j + (msgsize * rank); // each proc gets different ints
+double percentile(double *sorted, int n, double pct) {
+  int idx = (int)(pct * n + 0.999999) - 1; // nearest-rank
+  if (idx < 0)
+    idx = 0;
+  if (idx >= n)
+    idx = n - 1;
+  return sorted[idx];
+}
+
+void bench_collective(const struct collective *op, int count, int rank,
+                      int size) {
+  int type_s;
+  MPI_Type_size(ELEM_TYPE, &type_s);
+  size_t send_bytes = (size_t)count * blocks(op->send_scale, size) * type_s;
+  size_t recv_bytes = (size_t)count * blocks(op->recv_scale, size) * type_s;
+
+  // ROTATE copies of each buffer, cycled so repeats don't hit warm lines
+  void **sendbufs = malloc(ROTATE * sizeof(void *));
+  void **recvbufs = malloc(ROTATE * sizeof(void *));
+  for (int r = 0; r < ROTATE; r++) {
+    sendbufs[r] = malloc(send_bytes);
+    recvbufs[r] = calloc(recv_bytes, 1);
+    if (sendbufs[r] == NULL || recvbufs[r] == NULL) {
+      fprintf(stderr, "Allocating the message buffers failed.\n");
+      MPI_Abort(MPI_COMM_WORLD, 1);
     }
-    recvbuf = (int *)calloc(msgsize * size, (sizeof(int)));
+    fill_sendbuf(op, sendbufs[r], count, rank, size);
+  }
 
+  double *times = malloc(ITERATIONS * sizeof(double));
+  double t1, t2, tmax;
+  bool ok = true;
+  for (int n = -WARMUP; n < ITERATIONS; n++) {
+    int r = (n + WARMUP) % ROTATE;
+    flush_cache();
     MPI_Barrier(MPI_COMM_WORLD);
     t1 = MPI_Wtime();
-    for (int n = 0; n < TIMES_TO_TEST; n++) {
-      allgather(sendbuf, msgsize, MPI_INT, recvbuf, msgsize, MPI_INT,
-                MPI_COMM_WORLD);
-    }
+    op->run(sendbufs[r], recvbufs[r], count, ELEM_TYPE, MPI_COMM_WORLD);
     t2 = MPI_Wtime() - t1;
-    MPI_Barrier(MPI_COMM_WORLD);
-    MPI_Reduce(&t2, &t1, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    // an iteration is as slow as its slowest process
+    MPI_Reduce(&t2, &tmax, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (n >= 0) {
+      times[n] = tmax;
+      ok = ok && check_recvbuf(op, recvbufs[r], count, rank, size);
+    }
+    // clear it now, so with ROTATE > 1 it has gone cold again by its next use
+    memset(recvbufs[r], 0, recv_bytes);
+  }
+
+  bool all_ok;
+  MPI_Reduce(&ok, &all_ok, 1, MPI_C_BOOL, MPI_LAND, 0, MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    qsort(times, ITERATIONS, sizeof(double), compare_doubles);
+    double tmin = times[0];
+    double tmed = percentile(times, ITERATIONS, 0.50);
+    double tp99 = percentile(times, ITERATIONS, 0.99);
+    double gbps = recv_bytes / tmed / 1e9; // bytes landing in each recvbuf
+    // below 100 samples the nearest-rank p99 is just the maximum; leave it out
+    char p99[32] = "";
+    if (ITERATIONS >= 100) {
+      snprintf(p99, sizeof(p99), CSV ? "%.9f" : "%12.3e", tp99);
+    } else if (!CSV) {
+      snprintf(p99, sizeof(p99), "%12s", "-");
+    }
+    if (CSV) {
+      printf("%s,%s,%d,%d,%zu,%d,%.9f,%.9f,%s,%.6f,%s\n", op->name,
+             type_name(ELEM_TYPE), size, count, recv_bytes, ITERATIONS, tmin,
+             tmed, p99, gbps, all_ok ? "ok" : "FAIL");
+    } else {
+      printf("%-16s %10d %12zu %12.3e %12.3e %s %10.3f %s\n", op->name, count,
+             recv_bytes, tmin, tmed, p99, gbps, all_ok ? "" : "VERIFY FAILED");
+    }
+    fflush(stdout);
+  }
+
+  for (int r = 0; r < ROTATE; r++) {
+    free(sendbufs[r]);
+    free(recvbufs[r]);
+  }
+  free(sendbufs);
+  free(recvbufs);
+  free(times);
+}
+
+int main(int argc, char **argv) {
+  int c;
+  int option_index = 0;
+  ELEM_TYPE = MPI_INT;
+  static struct option long_options[] = {
+      {"help", no_argument, 0, 'H'},
+      {"csv", no_argument, &CSV, 'c'},
+      {"warmup", required_argument, 0, 'w'},
+      {"iterations", required_argument, 0, 'i'},
+      {"min-exp", required_argument, 0, 'm'},
+      {"max-exp", required_argument, 0, 'M'},
+      {"type", required_argument, 0, 't'},
+      {"rotate", required_argument, 0, 'r'},
+      {"flush", required_argument, 0, 'f'},
+      {"segment", required_argument, 0, 's'},
+      {0, 0, 0, 0},
+  };
 
-    for (int m = 0; m < msgsize * size; m++) {
-      assert(recvbuf[m] == m);
+  while ((c = getopt_long(argc, argv, "Hcw:i:m:M:t:r:f:s:", long_options,
+                          &option_index)) != -1) {
+    switch (c) {
+    case 'H':
+      printf("\n");
+      printf("\tCollective communication benchmark\n");
+      printf("\t\t-H/--help: See this dialog and exit.\n");
+      printf("\t\t-w/--warmup: Untimed iterations per message size.\n");
+      printf("\t\t\t Defaults to 2.\n");
+      printf("\t\t-i/--iterations: Timed iterations per message size.\n");
+      printf("\t\t\t Defaults to 100; p99 is left out below 100.\n");
+      printf("\t\t-m/--min-exp: Smallest message is 2^m elements.\n");
+      printf("\t\t\t Defaults to 5.\n");
+      printf("\t\t-M/--max-exp: Largest message is 2^M elements.\n");
+      printf("\t\t\t Defaults to 20.\n");
+      printf("\t\t-t/--type: Element type: char, int, long or double.\n");
+      printf("\t\t\t Defaults to int.\n");
+      printf("\t\t-r/--rotate: Cycle through this many buffer sets.\n");
+      printf("\t\t\t Defaults to 1.\n");
+      printf("\t\t-f/--flush: Write this many MiB between iterations to\n");
+      printf("\t\t\t evict the caches. Defaults to 0 (off).\n");
+      printf("\t\t-s/--segment: Pipelined broadcast segment size in KiB.\n");
+      printf("\t\t\t Defaults to 64.\n");
+      printf("\t\t-c/--csv: Print results as CSV.\n");
+      printf("\t\t\t Defaults to False.\n");
+      printf("\n");
+      printf("\t\tReported times are the slowest process per iteration.\n");
+      printf("\t\tBandwidth is per-process received bytes / median time.\n");
+      printf("\n");
+      printf("\t\tExample:\n");
+      printf("\t\t\tmpiexec -n 4 ./proc -m 10 -M 16 -t double -i 50 -c\n");
+      printf("\n");
+      exit(0);
+    case 'c':
+      CSV = true;
+      break;
+    case 'w':
+      WARMUP = atoi(optarg);
+      break;
+    case 'i':
+      ITERATIONS = atoi(optarg);
+      break;
+    case 'm':
+      MIN_EXP = atoi(optarg);
+      break;
+    case 'M':
+      MAX_EXP = atoi(optarg);
+      break;
+    case 't':
+      ELEM_TYPE = parse_type(optarg);
+      break;
+    case 'r':
+      ROTATE = atoi(optarg);
+      break;
+    case 'f':
+      FLUSH_BYTES = atol(optarg) * 1024 * 1024;
+      break;
+    case 's':
+      SEGMENT_BYTES = atol(optarg) * 1024;
+      break;
     }
+  }
+
+  if (ITERATIONS < 1 || WARMUP < 0 || ROTATE < 1 || SEGMENT_BYTES < 1 ||
+      MIN_EXP < 0 || MAX_EXP > 30 || MIN_EXP > MAX_EXP) {
+    fprintf(stderr, "Invalid benchmark parameters; see --help.\n");
+    exit(1);
+  }
 
+  int rank, size;
+  MPI_Init(NULL, NULL);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  // element counts are ints, and the all-to-alls move count * size of them
+  if ((1L << MAX_EXP) * size > INT_MAX) {
     if (rank == 0) {
-      printf("Time taken in process 0 = %g\n", t2);
-      printf("Maximum time taken among all processes = %g\n", t1);
-      printf("Message size was %d\n", msgsize);
+      fprintf(stderr, "2^%d elements x %d procs overflows an int count; "
+                      "lower --max-exp.\n",
+              MAX_EXP, size);
+    }
+    MPI_Finalize();
+    exit(1);
+  }
+
+  if (FLUSH_BYTES > 0) {
+    FLUSHBUF = calloc(FLUSH_BYTES, 1);
+  }
+
+  if (rank == 0) {
+    if (CSV) {
+      printf("op,type,procs,count,bytes,iterations,min_s,median_s,p99_s,"
+             "gbps,verify\n");
+    } else {
+      printf("%d procs, %s elements, %d warmup + %d timed iterations\n", size,
+             type_name(ELEM_TYPE), WARMUP, ITERATIONS);
+      printf("%-16s %10s %12s %12s %12s %12s %10s\n", "op", "count", "bytes",
+             "min(s)", "median(s)", "p99(s)", "GB/s");
+    }
+  }
+
+  for (int o = 0; o < N_COLLECTIVES; o++) {
+    for (int i = MIN_EXP; i <= MAX_EXP; i++) {
+      bench_collective(&COLLECTIVES[o], 1 << i, rank, size);
     }
-    free(sendbuf);
-    free(recvbuf);
   }
 
+  free(FLUSHBUF);
+  free_hierarchy();
   MPI_Finalize();
   return 0;
 }
@@ -0,0 +1,90 @@
+/*
+  Per-host tuning cache for the drivers; see tune_cache.h.
+  Instructions to compile:
+    linked into `make life_openmp life_mpi`
+    See Makefile for details
+*/
+
+#define _GNU_SOURCE
+#include "tune_cache.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+char *tune_cache_path(const char *prog) {
+  char host[256] = "localhost";
+  gethostname(host, sizeof(host) - 1);
+  const char *dir = getenv("XDG_CACHE_HOME");
+  char *path = malloc(4096);
+  if (path == NULL) {
+    return NULL;
+  }
+  if (dir != NULL && dir[0] != '\0') {
+    snprintf(path, 4096, "%s", dir);
+  } else {
+    snprintf(path, 4096, "%s/.cache", getenv("HOME") ? getenv("HOME") : ".");
+  }
+  size_t len = strlen(path);
+  snprintf(path + len, 4096 - len, "/%s.%s", prog, host);
+  return path;
+}
+
+static bool same_keys(const char *a, const char *b, int keys) {
+  // compare the first `keys` fields, ignoring how they are spaced
+  for (int k = 0; k < keys; k++) {
+    a += strspn(a, " \t");
+    b += strspn(b, " \t");
+    size_t la = strcspn(a, " \t\n");
+    size_t lb = strcspn(b, " \t\n");
+    if (la == 0 || la != lb || strncmp(a, b, la) != 0) {
+      return false;
+    }
+    a += la;
+    b += lb;
+  }
+  return true;
+}
+
+int tune_cache_save(const char *path, const char *header, const char *entry,
+                    int keys) {
+  char **lines = NULL;
+  int nlines = 0;
+  char line[256];
+  FILE *in = fopen(path, "r");
+  while (in != NULL && fgets(line, sizeof(line), in) != NULL) {
+    if (line[0] == '#' || same_keys(line, entry, keys)) {
+      continue;
+    }
+    lines = realloc(lines, (nlines + 1) * sizeof(char *));
+    lines[nlines++] = strdup(line);
+  }
+  if (in != NULL) {
+    fclose(in);
+  }
+
+  FILE *out = fopen(path, "w");
+  char *slash = strrchr(path, '/');
+  if (out == NULL && slash != NULL) { // e.g. a fresh ~/.cache
+    char *dir = strndup(path, slash - path);
+    if (dir != NULL && mkdir(dir, 0755) == 0) {
+      out = fopen(path, "w");
+    }
+    free(dir);
+  }
+  if (out != NULL) {
+    fprintf(out, "%s\n", header);
+    for (int i = 0; i < nlines; i++) {
+      fputs(lines[i], out);
+    }
+    fprintf(out, "%s\n", entry);
+    fclose(out);
+  }
+  for (int i = 0; i < nlines; i++) {
+    free(lines[i]);
+  }
+  free(lines);
+  return out != NULL ? 0 : -1;
+}
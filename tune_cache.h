@@ -0,0 +1,21 @@
+/*
+  Per-host tuning cache shared by life_openmp and life_mpi.
+  One entry per line, whitespace-separated fields; lines starting with # are
+  comments. Each program defines its own fields and how entries are matched.
+*/
+
+#ifndef TUNE_CACHE_H
+#define TUNE_CACHE_H
+
+// $XDG_CACHE_HOME/<prog>.<hostname>, falling back to ~/.cache. Nothing is
+// created until tune_cache_save. The caller frees the result; NULL if
+// allocation fails.
+char *tune_cache_path(const char *prog);
+
+// Rewrite the cache at path as header, the old entries whose first `keys`
+// fields differ from entry's, then entry, creating the cache directory if
+// needed. Returns -1 if it can't be written.
+int tune_cache_save(const char *path, const char *header, const char *entry,
+                    int keys);
+
+#endif